@@ -1,11 +1,43 @@
 #include <gmpxx.h>
 #include <mpfr.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <iostream>
+#include <sstream>
+#include <fstream>
 #include <string>
 #include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <climits>
 #include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PI_X86 1
+#include <immintrin.h>
+#endif
+
+#include "pi_digits_table.h"
 
 /* =========================
    Small helpers
@@ -134,7 +166,128 @@ static bool parse_digit_spec(const std::string &spec, unsigned long &out_digits)
     return true;
 }
 
-/* Get digits from command-line arguments.
+// Digit counts, term indices and bit sizes are unsigned long throughout.
+static_assert(sizeof(unsigned long) >= 8, "a 64-bit unsigned long is required");
+
+/* Command-line options. */
+struct Options {
+    unsigned long digits  = 100000UL;  // default
+    unsigned      threads = 0;         // 0 = one per usable CPU (see detect_limits)
+    bool          auto_threads = false; // threads came from detect_limits, not -t
+    std::string   constant = "pi";     // see CONSTANTS below
+    unsigned long root_radicand = 0;   // --sqrt / --root: radicand^(1/degree)
+    unsigned long root_degree   = 0;   // 0 = not in root mode
+    bool          emit_table    = false; // write pi_digits_table.h to stdout
+    bool          truncate      = false; // truncated merges near the root
+    unsigned long digit_at      = 0;     // --digit-at position (0 = off)
+    unsigned long cf_terms      = 0;     // --continued-fraction terms (0 = off)
+    unsigned long range_start   = 0;     // --range: digits skipped after the point
+    unsigned long range_len     = 0;     // --range: window length (0 = off)
+    bool          stats         = false; // --stats: randomness tests on the output
+    unsigned long stats_block   = 1000000UL; // --stats-block: digits per block
+    std::vector<std::string> search;     // --search patterns (no digit output)
+    std::string   index_input;           // --build-index: digit file
+    std::string   index_path;            // --build-index output / --query input
+    std::vector<std::string> query;      // --query patterns
+    std::string   compare_a, compare_b;  // --compare files
+    std::string   trace_mul;             // --trace-mul: record the big products here
+    std::string   isa;                   // --isa: highest SIMD level to use (empty = best)
+    std::string   replay;                // --replay: benchmark the backends on a trace
+    std::string   pack_in, pack_out;     // --pack-digits files
+    bool          self_check    = false; // --self-check: compare digests with the reference
+    bool          energy        = false; // --energy: RAPL energy per phase
+    bool          cost          = false; // --cost: deterministic operation counts
+};
+
+/* Parse "P1,P2,..." or "@file" (one pattern per line) for --search / --query. */
+static bool parse_pattern_list(const std::string &spec, std::vector<std::string> &out) {
+    std::string list = spec;
+    char sep = ',';
+    if (!spec.empty() && spec[0] == '@') {
+        std::ifstream in(spec.substr(1));
+        if (!in) {
+            std::cerr << "Cannot read patterns from \"" << spec.substr(1) << "\"\n";
+            return false;
+        }
+        std::ostringstream text;
+        text << in.rdbuf();
+        list = text.str();
+        sep = '\n';
+    }
+
+    std::istringstream items(list);
+    std::string item;
+    while (std::getline(items, item, sep)) {
+        item = trim(item);
+        if (item.empty()) continue;
+        for (char c : item) {
+            if (c < '0' || c > '9') {
+                std::cerr << "Search patterns must be decimal digits, got \"" << item << "\"\n";
+                return false;
+            }
+        }
+        out.push_back(item);
+    }
+    if (out.empty()) {
+        std::cerr << "No search patterns in \"" << spec << "\"\n";
+        return false;
+    }
+    return true;
+}
+
+/* Parse "start:len" for --range. */
+static bool parse_range_spec(const std::string &spec, Options &opts) {
+    auto colon = spec.find(':');
+    if (colon == std::string::npos) {
+        std::cerr << "Expected start:len, got \"" << spec << "\"\n";
+        return false;
+    }
+    if (!parse_digit_spec(spec.substr(0, colon), opts.range_start) ||
+        !parse_digit_spec(spec.substr(colon + 1), opts.range_len)) {
+        return false;
+    }
+    if (opts.range_len == 0) {
+        std::cerr << "Empty digit range \"" << spec << "\"\n";
+        return false;
+    }
+    if (opts.range_start > ULONG_MAX - opts.range_len) {
+        std::cerr << "Digit range \"" << spec << "\" is out of bounds\n";
+        return false;
+    }
+    return true;
+}
+
+/* Parse "N" or "N:K" for --sqrt / --root. */
+static bool parse_root_spec(const std::string &spec, bool with_degree, Options &opts) {
+    std::string s = trim(spec);
+    auto colon = s.find(':');
+    if (with_degree != (colon != std::string::npos)) {
+        std::cerr << "Invalid root specification \"" << spec << "\"\n";
+        return false;
+    }
+    try {
+        std::size_t used = 0;
+        std::string n_str = with_degree ? s.substr(0, colon) : s;
+        opts.root_radicand = std::stoul(n_str, &used);
+        if (used != n_str.size()) throw std::invalid_argument(n_str);
+        opts.root_degree = 2;
+        if (with_degree) {
+            std::string k_str = s.substr(colon + 1);
+            opts.root_degree = std::stoul(k_str, &used);
+            if (used != k_str.size()) throw std::invalid_argument(k_str);
+        }
+    } catch (...) {
+        std::cerr << "Invalid root specification \"" << spec << "\"\n";
+        return false;
+    }
+    if (opts.root_degree < 2) {
+        std::cerr << "Root degree must be at least 2\n";
+        return false;
+    }
+    return true;
+}
+
+/* Parse command-line arguments.
  *
  * Supported forms:
  *   ./pi_chudnovsky               -> default (100000)
@@ -144,8 +297,30 @@ static bool parse_digit_spec(const std::string &spec, unsigned long &out_digits)
  *   ./pi_chudnovsky -c 321
  *   ./pi_chudnovsky -d 132876K
  *   ./pi_chudnovsky 1e6
+ *   ./pi_chudnovsky --threads 4 1M
+ *   ./pi_chudnovsky --constant zeta3 100K
+ *   ./pi_chudnovsky --sqrt 2 1M
+ *   ./pi_chudnovsky --root 3:5 1M        (fifth root of 3)
+ *   ./pi_chudnovsky --emit-table 10000 > pi_digits_table.h
+ *   ./pi_chudnovsky --truncate 10M
+ *   ./pi_chudnovsky --digit-at 10000
+ *   ./pi_chudnovsky --continued-fraction 100K
+ *   ./pi_chudnovsky --range 1M:100       (digits 1000001..1000100)
+ *   ./pi_chudnovsky --stats --stats-block 100K 1M
+ *   ./pi_chudnovsky --search 999999,271828 10M
+ *   ./pi_chudnovsky --search @patterns.txt 10M
+ *   ./pi_chudnovsky --build-index pi.txt pi.idx
+ *   ./pi_chudnovsky --query pi.idx 999999,271828
+ *   ./pi_chudnovsky --compare pi.txt reference.txt
+ *   ./pi_chudnovsky --pack-digits pi.txt pi.bcd
+ *   ./pi_chudnovsky --self-check 1M
+ *   ./pi_chudnovsky --energy 10M
+ *   ./pi_chudnovsky --cost 1M
+ *   ./pi_chudnovsky --trace-mul pi.mtr 10M
+ *   ./pi_chudnovsky --replay pi.mtr
+ *   ./pi_chudnovsky --isa avx2 --compare pi.txt reference.txt
  */
-static bool get_digits_from_args(int argc, char **argv, unsigned long &out_digits) {
+static bool parse_args(int argc, char **argv, Options &opts) {
     std::string digit_spec;
 
     for (int i = 1; i < argc; ++i) {
@@ -159,6 +334,120 @@ static bool get_digits_from_args(int argc, char **argv, unsigned long &out_digit
                 return false;
             }
             digit_spec = argv[++i];
+        } else if (arg == "--threads" || arg == "-t") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            unsigned long n = 0;
+            try {
+                n = std::stoul(argv[++i]);
+            } catch (...) {
+                n = 0;
+            }
+            if (n == 0 || n > 4096) {
+                std::cerr << "Invalid thread count \"" << argv[i] << "\"\n";
+                return false;
+            }
+            opts.threads = static_cast<unsigned>(n);
+        } else if (arg == "--constant" || arg == "-k") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            opts.constant = argv[++i];
+        } else if (arg == "--sqrt" || arg == "--root") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_root_spec(argv[++i], arg == "--root", opts)) return false;
+        } else if (arg == "--emit-table") {
+            opts.emit_table = true;
+        } else if (arg == "--truncate") {
+            opts.truncate = true;
+        } else if (arg == "--digit-at") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_digit_spec(argv[++i], opts.digit_at)) return false;
+            if (opts.digit_at == 0) {
+                std::cerr << "Digit positions start at 1\n";
+                return false;
+            }
+        } else if (arg == "--continued-fraction") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_digit_spec(argv[++i], opts.cf_terms)) return false;
+            if (opts.cf_terms == 0) {
+                std::cerr << "At least one partial quotient is needed\n";
+                return false;
+            }
+        } else if (arg == "--range") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_range_spec(argv[++i], opts)) return false;
+        } else if (arg == "--self-check") {
+            opts.self_check = true;
+        } else if (arg == "--energy") {
+            opts.energy = true;
+        } else if (arg == "--cost") {
+            opts.cost = true;
+        } else if (arg == "--stats") {
+            opts.stats = true;
+        } else if (arg == "--stats-block") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_digit_spec(argv[++i], opts.stats_block)) return false;
+            if (opts.stats_block == 0) {
+                std::cerr << "Statistics blocks must hold at least one digit\n";
+                return false;
+            }
+            opts.stats = true;
+        } else if (arg == "--search") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            if (!parse_pattern_list(argv[++i], opts.search)) return false;
+        } else if (arg == "--trace-mul" || arg == "--replay") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            (arg == "--trace-mul" ? opts.trace_mul : opts.replay) = argv[++i];
+        } else if (arg == "--isa") {
+            if (i + 1 >= argc) {
+                std::cerr << "Flag " << arg << " requires a value\n";
+                return false;
+            }
+            opts.isa = argv[++i];
+        } else if (arg == "--build-index" || arg == "--query" ||
+                   arg == "--compare" || arg == "--pack-digits") {
+            if (i + 2 >= argc) {
+                std::cerr << "Flag " << arg << " requires two values\n";
+                return false;
+            }
+            if (arg == "--build-index") {
+                opts.index_input = argv[++i];
+                opts.index_path  = argv[++i];
+            } else if (arg == "--query") {
+                opts.index_path = argv[++i];
+                if (!parse_pattern_list(argv[++i], opts.query)) return false;
+            } else if (arg == "--compare") {
+                opts.compare_a = argv[++i];
+                opts.compare_b = argv[++i];
+            } else {
+                opts.pack_in  = argv[++i];
+                opts.pack_out = argv[++i];
+            }
         } else if (arg.size() > 0 && arg[0] != '-' && digit_spec.empty()) {
             // First bare argument: treat as digits spec
             digit_spec = arg;
@@ -168,176 +457,5005 @@ static bool get_digits_from_args(int argc, char **argv, unsigned long &out_digit
     }
 
     if (digit_spec.empty()) {
-        out_digits = 100000UL;  // default
         return true;
     }
 
-    return parse_digit_spec(digit_spec, out_digits);
+    return parse_digit_spec(digit_spec, opts.digits);
 }
 
 /* =========================
-   Chudnovsky binary split
+   Resource limits
    ========================= */
 
 /*
- * Binary splitting for the Chudnovsky series.
- *
- * We compute P(a, b), Q(a, b), T(a, b) such that:
- *   π = (Q(0, N) * 426880 * sqrt(10005)) / T(0, N)
+ * In a container the host's CPU and RAM counts overstate what the run
+ * may use. The usable CPU count is the smallest of the online CPUs,
+ * the affinity mask and the cgroup CPU quota (v2 cpu.max, v1
+ * cpu.cfs_quota_us / cpu.cfs_period_us). The memory budget is the
+ * smallest of physical RAM and the cgroup limit (v2 memory.max, v1
+ * memory.limit_in_bytes). Limits are taken from every level between
+ * the process's cgroup and the hierarchy's mount point, since a parent
+ * limit also applies.
  */
-static void binary_split(unsigned long a, unsigned long b,
-                         mpz_class &P, mpz_class &Q, mpz_class &T) {
-    if (b - a == 1) {
-        if (a == 0) {
-            P = 1;
-            Q = 1;
-            T = 13591409L;
-        } else {
-            unsigned long k = a;
 
-            // P_k = (6k - 5)(2k - 1)(6k - 1)
-            mpz_class term1(6UL * k - 5UL);
-            mpz_class term2(2UL * k - 1UL);
-            mpz_class term3(6UL * k - 1UL);
-            P = term1 * term2 * term3;
+struct ResourceLimits {
+    unsigned      cpus   = 1;
+    std::uint64_t memory = 0;      // bytes
+    std::string   cpu_source;      // cgroup file that set cpus, if any
+    std::string   memory_source;   // cgroup file that set memory, if any
+};
 
-            // Q_k = k^3 * C^3 / 24, where C = 640320
-            // C^3 / 24 = 10939058860032000
-            mpz_class k3 = mpz_class(k) * k * k;      // k^3
-            mpz_class c3_over_24("10939058860032000"); // <-- fixed
-            Q = k3 * c3_over_24;
+static bool read_first_line(const std::string &path, std::string &line) {
+    std::ifstream in(path);
+    return in && std::getline(in, line);
+}
 
-            // T_k = (-1)^k * (13591409 + 545140134 k) * P_k
-            mpz_class val = 545140134L;
-            val *= k;
-            val += 13591409L;
-            if (k % 2 == 1) {
-                val = -val;
-            }
+/*
+ * Directory of this process's cgroup for a v1 controller, or for the v2
+ * hierarchy when controller is empty; sets mount to the hierarchy root.
+ */
+static bool cgroup_dir(const std::string &controller, std::string &dir, std::string &mount) {
+    std::ifstream mounts("/proc/self/mountinfo");
+    std::string line, mount_root;
+    bool found = false;
+    while (!found && std::getline(mounts, line)) {
+        // id parent dev root mountpoint options [tags] - fstype source superoptions
+        std::istringstream fields(line);
+        std::string id, parent, dev, mroot, point, field;
+        fields >> id >> parent >> dev >> mroot >> point;
+        while (fields >> field && field != "-") {
+        }
+        std::string fstype, source, super;
+        fields >> fstype >> source >> super;
+        if (controller.empty()) {
+            found = fstype == "cgroup2";
+        } else if (fstype == "cgroup") {
+            std::istringstream opts(super);
+            while (!found && std::getline(opts, field, ',')) found = field == controller;
+        }
+        if (found) {
+            mount = point;
+            mount_root = mroot;
+        }
+    }
+    if (!found) return false;
+
+    std::ifstream groups("/proc/self/cgroup");
+    while (std::getline(groups, line)) {
+        // id:controllers:path
+        std::size_t a = line.find(':'), b = line.find(':', a + 1);
+        if (a == std::string::npos || b == std::string::npos) continue;
+        std::string names = line.substr(a + 1, b - a - 1), path = line.substr(b + 1);
+        bool match = controller.empty() ? line.compare(0, a, "0") == 0 && names.empty() : false;
+        std::istringstream list(names);
+        std::string name;
+        while (!controller.empty() && !match && std::getline(list, name, ',')) {
+            match = name == controller;
+        }
+        if (!match) continue;
+
+        // paths outside the mount's root (another cgroup namespace) map to the mount itself
+        if (mount_root != "/" && path.compare(0, mount_root.size(), mount_root) == 0) {
+            path = path.substr(mount_root.size());
+        } else if (mount_root != "/") {
+            path.clear();
+        }
+        dir = mount + (path == "/" ? "" : path);
+        return true;
+    }
+    return false;
+}
 
-            T = val * P;
+/*
+ * Smallest limit that parse(dir, first line, limit) reads from `file` in
+ * dir and its parents up to mount; false when no level sets one.
+ */
+template <class Parse>
+static bool cgroup_min(std::string dir, const std::string &mount, const char *file,
+                       Parse parse, double &limit, std::string &source) {
+    bool found = false;
+    for (;;) {
+        std::string line;
+        double value = 0;
+        if (read_first_line(dir + "/" + file, line) && parse(dir, line, value) &&
+            (!found || value < limit)) {
+            limit = value;
+            source = dir + "/" + file;
+            found = true;
         }
+        if (dir.size() <= mount.size()) break;
+        dir.erase(dir.find_last_of('/'));
+    }
+    return found;
+}
+
+static ResourceLimits detect_limits() {
+    ResourceLimits lim;
+    lim.cpus = std::thread::hardware_concurrency();
+    if (lim.cpus == 0) lim.cpus = 1;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0) {
+        lim.cpus = std::min<unsigned>(lim.cpus, static_cast<unsigned>(CPU_COUNT(&set)));
+    }
+    lim.memory = static_cast<std::uint64_t>(sysconf(_SC_PHYS_PAGES)) *
+                 static_cast<std::uint64_t>(sysconf(_SC_PAGE_SIZE));
+
+    auto v2_cpu = [](const std::string &, const std::string &line, double &cpus) {
+        std::istringstream in(line);
+        std::string quota;
+        double period = 0;
+        if (!(in >> quota >> period) || quota == "max" || period <= 0) return false;
+        cpus = std::atof(quota.c_str()) / period;
+        return cpus > 0;
+    };
+    auto v2_memory = [](const std::string &, const std::string &line, double &bytes) {
+        if (line == "max") return false;
+        bytes = std::atof(line.c_str());
+        return bytes > 0;
+    };
+    // v1 spells "no limit" as a quota of -1 and as a near-2^63 byte count
+    auto v1_cpu = [](const std::string &dir, const std::string &line, double &cpus) {
+        double quota = std::atof(line.c_str());
+        std::string period;
+        if (quota <= 0 || !read_first_line(dir + "/cpu.cfs_period_us", period)) return false;
+        cpus = quota / std::atof(period.c_str());
+        return cpus > 0;
+    };
+    auto v1_memory = [](const std::string &, const std::string &line, double &bytes) {
+        bytes = std::atof(line.c_str());
+        return bytes > 0 && bytes < 4.0e18;
+    };
+
+    double cpus = 0, memory = 0;
+    std::string dir, mount;
+    bool have_cpu = false, have_memory = false;
+    if (cgroup_dir("", dir, mount)) {
+        have_cpu = cgroup_min(dir, mount, "cpu.max", v2_cpu, cpus, lim.cpu_source);
+        have_memory = cgroup_min(dir, mount, "memory.max", v2_memory, memory, lim.memory_source);
+    }
+    if (!have_cpu && cgroup_dir("cpu", dir, mount)) {
+        have_cpu = cgroup_min(dir, mount, "cpu.cfs_quota_us", v1_cpu, cpus, lim.cpu_source);
+    }
+    if (!have_memory && cgroup_dir("memory", dir, mount)) {
+        have_memory = cgroup_min(dir, mount, "memory.limit_in_bytes", v1_memory, memory,
+                                 lim.memory_source);
+    }
+
+    unsigned quota_cpus = have_cpu ? std::max(1u, static_cast<unsigned>(std::ceil(cpus))) : 0;
+    if (have_cpu && quota_cpus < lim.cpus) {
+        lim.cpus = quota_cpus;
     } else {
-        unsigned long m = (a + b) / 2;
+        lim.cpu_source.clear();
+    }
+    if (have_memory && memory < static_cast<double>(lim.memory)) {
+        lim.memory = static_cast<std::uint64_t>(memory);
+    } else {
+        lim.memory_source.clear();
+    }
+    return lim;
+}
 
-        mpz_class P1, Q1, T1;
-        mpz_class P2, Q2, T2;
+/*
+ * Peak memory of a pi run, measured: about 12 bytes per digit on one
+ * thread and 2 more per doubling of the threads (concurrent subtrees hold
+ * their own products), 4 more from 5 threads on (the Toom-3 evaluations
+ * of the top products), plus a fixed 16 MiB.
+ */
+static std::uint64_t estimate_peak_bytes(unsigned long digits, unsigned threads) {
+    double per_digit = 12.0 + 2.0 * std::log2(static_cast<double>(std::max(threads, 1u)));
+    if (threads >= 5) per_digit += 4.0;
+    return static_cast<std::uint64_t>(per_digit * static_cast<double>(digits)) + (16ULL << 20);
+}
 
-        binary_split(a, m, P1, Q1, T1);
-        binary_split(m, b, P2, Q2, T2);
+static std::string format_bytes(std::uint64_t bytes) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    if (bytes >= (1ULL << 30)) out << static_cast<double>(bytes) / (1ULL << 30) << " GiB";
+    else out << static_cast<double>(bytes) / (1ULL << 20) << " MiB";
+    return out.str();
+}
 
-        // T(a, b) = Q(m, b) * T(a, m) + P(a, m) * T(m, b)
-        T = Q2 * T1 + P1 * T2;
+/*
+ * Fit the thread count to the memory budget (only when it was not given
+ * explicitly) and print the plan when a cgroup limit applies or the run
+ * looks too large for the budget.
+ */
+static void plan_resources(Options &opts, const ResourceLimits &lim, bool auto_threads,
+                           unsigned long digits) {
+    // keep a tenth of the budget for the output string and the allocator
+    const std::uint64_t budget = lim.memory / 10 * 9;
+    unsigned threads = opts.threads;
+    if (auto_threads) {
+        while (threads > 1 && estimate_peak_bytes(digits, threads) > budget) threads /= 2;
+    }
+    std::uint64_t peak = estimate_peak_bytes(digits, threads);
+    unsigned requested = opts.threads;
+    bool reduced = threads != requested;
+    opts.threads = threads;
 
-        // P(a, b) = P(a, m) * P(m, b)
-        // Q(a, b) = Q(a, m) * Q(m, b)
-        P = P1 * P2;
-        Q = Q1 * Q2;
+    if (lim.cpu_source.empty() && lim.memory_source.empty() && !reduced && peak <= budget) {
+        return;
+    }
+    std::cout << "Plan: " << threads << (threads == 1 ? " thread" : " threads");
+    if (!lim.cpu_source.empty()) std::cout << " (" << lim.cpus << " CPUs from " << lim.cpu_source << ")";
+    if (reduced) std::cout << " (down from " << requested << " to fit memory)";
+    std::cout << ", memory budget " << format_bytes(budget);
+    if (!lim.memory_source.empty()) std::cout << " (" << format_bytes(lim.memory) << " from " << lim.memory_source << ")";
+    std::cout << ", estimated peak " << format_bytes(peak) << '\n';
+    if (peak > budget) {
+        std::cout << "Warning: the estimated peak exceeds the memory budget; "
+                  << "the run may be killed\n";
     }
 }
 
 /* =========================
-   Main
+   Operation counts
    ========================= */
 
-int main(int argc, char **argv) {
-    unsigned long digits;
-    if (!get_digits_from_args(argc, argv, digits)) {
-        std::cerr << "Usage examples:\n"
-                  << "  " << argv[0] << "\n"
-                  << "  " << argv[0] << " 12345\n"
-                  << "  " << argv[0] << " --calculate 1K\n"
-                  << "  " << argv[0] << " --digits 10M\n"
-                  << "  " << argv[0] << " 1e6\n";
-        return 1;
+/*
+ * --cost counts the limb-level work of the binary split and the final
+ * stage and prints a deterministic total, for regression tests on
+ * shared hosts where wall-clock times are noise. The multiplication
+ * layer (big_mul, big_add, the mpn helpers of the small pi path and the
+ * MPFR calls of the final stage) reports every operation with its
+ * operand sizes, and a fixed cost model turns them into limb-ops:
+ *
+ *   smaller operand < COST_KARATSUBA_LIMBS   n * m (schoolbook)
+ *   smaller operand < COST_FFT_LIMBS         Karatsuba on m x m blocks:
+ *                                            3^L products of m/2^L limbs
+ *   otherwise                                FFT of length L >= n + m:
+ *                                            3 transforms of 4 L log2 L
+ *                                            plus 16 L for the pointwise
+ *                                            products
+ *   addition                                 max(n, m)
+ *   division, square root                    three products at the size
+ *                                            of the quotient / root
+ *
+ * The constants make the three regions meet within ~20% at their
+ * thresholds. They belong to the model, not to GMP's tuned ones, and the
+ * split tree does not depend on the thread count, so the figures are the
+ * same on every machine, GMP build and -t value. They change only when
+ * the algorithm does.
+ */
+
+static const std::uint64_t COST_KARATSUBA_LIMBS = 32;
+static const std::uint64_t COST_FFT_LIMBS       = 4096;
+
+// Multiplications are binned by floor(log2(smaller operand limbs)).
+static const unsigned COST_CLASSES = 48;
+
+struct CostCounters {
+    std::atomic<std::uint64_t> mul_count[COST_CLASSES];
+    std::atomic<std::uint64_t> mul_ops[COST_CLASSES];
+    std::atomic<std::uint64_t> adds, add_ops;
+    std::atomic<std::uint64_t> transforms;
+};
+
+static bool cost_counting = false;
+static CostCounters cost;
+
+/* Model cost of an n x m limb product; adds the FFT transforms used. */
+static std::uint64_t cost_model_mul(std::uint64_t n, std::uint64_t m, std::uint64_t &transforms) {
+    if (n < m) std::swap(n, m);
+    if (m == 0) return 0;
+    if (m < COST_KARATSUBA_LIMBS) return n * m;
+    if (m < COST_FFT_LIMBS) {
+        std::uint64_t products = 1, size = m;
+        while (size >= COST_KARATSUBA_LIMBS) {
+            size = (size + 1) / 2;
+            products *= 3;
+        }
+        return (n + m - 1) / m * products * size * size;
+    }
+    std::uint64_t len = 1, lg = 0;
+    while (len < n + m) {
+        len <<= 1;
+        ++lg;
     }
+    transforms += 3;
+    return 3 * 4 * len * lg + 16 * len;
+}
 
-    std::cout << "Calculating pi to " << digits
-              << " digits (C++ + GMP/MPFR, Chudnovsky)...\n";
+static void cost_mul(std::uint64_t n, std::uint64_t m) {
+    if (!cost_counting) return;
+    std::uint64_t transforms = 0;
+    std::uint64_t ops = cost_model_mul(n, m, transforms);
+    std::uint64_t small = std::max<std::uint64_t>(std::min(n, m), 1);
+    unsigned cls = 0;
+    while (cls + 1 < COST_CLASSES && (small >> (cls + 1)) != 0) ++cls;
+    cost.mul_count[cls].fetch_add(1, std::memory_order_relaxed);
+    cost.mul_ops[cls].fetch_add(ops, std::memory_order_relaxed);
+    if (transforms) cost.transforms.fetch_add(transforms, std::memory_order_relaxed);
+}
 
-    auto start = std::chrono::high_resolution_clock::now();
+static void cost_add(std::uint64_t n) {
+    if (!cost_counting) return;
+    cost.adds.fetch_add(1, std::memory_order_relaxed);
+    cost.add_ops.fetch_add(n, std::memory_order_relaxed);
+}
 
-    // Chudnovsky terms (~14 digits per term)
-    unsigned long terms = digits / 14 + 1;
+/* An n-limb by d-limb division: reciprocal (two products) and back-multiply. */
+static void cost_div(std::uint64_t n, std::uint64_t d) {
+    std::uint64_t q = n >= d ? n - d + 1 : 1;
+    cost_mul(q, q);
+    cost_mul(q, q);
+    cost_mul(d, q);
+}
 
-    mpz_class P, Q, T;
-    binary_split(0, terms, P, Q, T);
-
-    // Precision in bits: bits ≈ digits * log2(10) + margin
-    const double bits_per_digit = 3.321928094887362; // log2(10)
-    const double extra_bits     = 256.0;
-    mpfr_prec_t prec = static_cast<mpfr_prec_t>(digits * bits_per_digit + extra_bits);
-
-    // MPFR variables
-    mpfr_t sqrt10005, num, den, pi, scale, pi_scaled, pi_floor;
-    mpfr_init2(sqrt10005, prec);
-    mpfr_init2(num,       prec);
-    mpfr_init2(den,       prec);
-    mpfr_init2(pi,        prec);
-    mpfr_init2(scale,     prec);
-    mpfr_init2(pi_scaled, prec);
-    mpfr_init2(pi_floor,  prec);
-
-    // sqrt(10005)
-    mpfr_set_ui(sqrt10005, 10005UL, MPFR_RNDN);
-    mpfr_sqrt(sqrt10005, sqrt10005, MPFR_RNDN);
-
-    // numerator = (Q * 426880) * sqrt(10005)
-    mpz_class Q_times_c = Q * 426880UL;
-    mpfr_set_z(num, Q_times_c.get_mpz_t(), MPFR_RNDN);
-    mpfr_mul(num, num, sqrt10005, MPFR_RNDN);
-
-    // denominator = T
-    mpfr_set_z(den, T.get_mpz_t(), MPFR_RNDN);
-
-    // pi = numerator / denominator
-    mpfr_div(pi, num, den, MPFR_RNDN);
+/* Square root of an n-limb number. */
+static void cost_sqrt(std::uint64_t n) {
+    std::uint64_t h = (n + 1) / 2;
+    for (int i = 0; i < 3; ++i) cost_mul(h, h);
+}
 
-    // scale = 10^digits
-    mpfr_ui_pow_ui(scale, 10UL, digits, MPFR_RNDN);
+/* base^e by left-to-right squaring, results capped at `cap` limbs (MPFR). */
+static void cost_pow(std::uint64_t base_bits, unsigned long e, std::uint64_t cap = UINT64_MAX) {
+    const std::uint64_t base = (base_bits + 63) / 64;
+    std::uint64_t bits = 0;
+    for (int bit = 63; bit >= 0; --bit) {
+        if (bits != 0) {
+            std::uint64_t n = std::min((bits + 63) / 64, cap);
+            cost_mul(n, n);
+            bits *= 2;
+        }
+        if ((e >> bit) & 1UL) {
+            if (bits != 0) cost_mul(std::min((bits + 63) / 64, cap), base);
+            bits += base_bits;
+        }
+    }
+}
 
-    // pi_scaled = pi * 10^digits
-    mpfr_mul(pi_scaled, pi, scale, MPFR_RNDN);
+static std::uint64_t prec_limbs(mpfr_prec_t prec) {
+    return (static_cast<std::uint64_t>(prec) + 63) / 64;
+}
 
-    // floor to truncate (no rounding)
-    mpfr_floor(pi_floor, pi_scaled);
+static void cost_report() {
+    std::uint64_t muls = 0, mul_ops = 0;
+    for (unsigned c = 0; c < COST_CLASSES; ++c) {
+        muls += cost.mul_count[c].load();
+        mul_ops += cost.mul_ops[c].load();
+    }
+    std::uint64_t adds = cost.adds.load(), add_ops = cost.add_ops.load();
+    std::cout << "Cost: " << mul_ops + add_ops << " limb-ops (" << muls << " multiplications, "
+              << adds << " additions, " << cost.transforms.load() << " transforms)\n";
+    for (unsigned c = 0; c < COST_CLASSES; ++c) {
+        std::uint64_t count = cost.mul_count[c].load();
+        if (count == 0) continue;
+        std::cout << "  mul " << (1ULL << c) << ".." << (2ULL << c) - 1 << " limbs: "
+                  << count << " x, " << cost.mul_ops[c].load() << " limb-ops\n";
+    }
+    if (adds != 0) std::cout << "  add: " << adds << " x, " << add_ops << " limb-ops\n";
+}
 
-    // convert to integer
-    mpz_class pi_int;
-    mpfr_get_z(pi_int.get_mpz_t(), pi_floor, MPFR_RNDN);
+/* =========================
+   Tracepoints
+   ========================= */
 
-    auto end = std::chrono::high_resolution_clock::now();
-    double elapsed =
-        std::chrono::duration<double>(end - start).count();
+/*
+ * USDT probes for bpftrace / perf (provider "pi"), compiled in when
+ * <sys/sdt.h> is available (systemtap-sdt-dev) and no-ops otherwise:
+ *
+ *   phase(id, name)                        a phase starts (see PHASE_NAMES)
+ *   merge__start(a, b, left_limbs, right_limbs)
+ *   merge__done(a, b, limbs)               binary split node [a, b); limbs
+ *                                          of T(a, m), T(m, b) and T(a, b)
+ *   mul__start(x_limbs, y_limbs)           big_mul (leaf products included), the
+ *   mul__done(limbs)                       mpn path's products and the final
+ *                                          stage's MPFR products
+ *   sqrt__start(limbs)                     final-stage square root (limbs of
+ *   sqrt__done(limbs)                      the radicand, then of the root)
+ *   div__start(num_limbs, den_limbs)       final-stage division
+ *   div__done(limbs)
+ *   write__start(offset, len)              one chunk of output digits
+ *   write__done(offset, len)
+ *
+ * An unattached probe is a single nop and its arguments are plain loads,
+ * so the build needs no flag. Example:
+ *
+ *   bpftrace -e 'usdt:./pi_chudnovsky_cpp:pi:mul__start
+ *                { @[arg0 + arg1] = count(); }'
+ */
 
-    std::cout << "Time: " << elapsed << " s\n";
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PI_HAVE_USDT 1
+#endif
+#endif
 
-    // Convert to base-10 string
-    std::string pi_str = pi_int.get_str(10);
-    std::size_t len = pi_str.size();
-    std::size_t needed = static_cast<std::size_t>(digits) + 1; // "3" + digits decimals
+#ifdef PI_HAVE_USDT
+#define PI_PROBE1(name, a1)             STAP_PROBE1(pi, name, a1)
+#define PI_PROBE2(name, a1, a2)         STAP_PROBE2(pi, name, a1, a2)
+#define PI_PROBE3(name, a1, a2, a3)     STAP_PROBE3(pi, name, a1, a2, a3)
+#define PI_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(pi, name, a1, a2, a3, a4)
+#else
+#define PI_PROBE1(name, a1)             ((void)0)
+#define PI_PROBE2(name, a1, a2)         ((void)0)
+#define PI_PROBE3(name, a1, a2, a3)     ((void)0)
+#define PI_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#endif
 
-    if (len < needed) {
-        // left-pad with zeros
-        std::string padded(needed - len, '0');
-        padded += pi_str;
-        pi_str.swap(padded);
-        len = needed;
+/* =========================
+   Progress snapshot
+   ========================= */
+
+/*
+ * kill -USR1 <pid> prints a snapshot of a running job on stderr without
+ * stopping it: the current phase and the time spent in each phase, how
+ * many series terms the binary split has summed, what every worker
+ * thread is doing (leaf batch, merge or waiting for a sibling, with its
+ * range and depth in the split tree), the digits written so far, and
+ * the live and peak memory held through GMP (MPFR allocates through it
+ * too).
+ *
+ * The computation only publishes relaxed atomic stores: a few per tree
+ * node and one per GMP allocation, next to a multiplication or a malloc.
+ * Memory is counted in the calling thread's own slot, so allocations
+ * never contend on a shared line; the handler sums the slots. A block is
+ * often freed by another thread than the one that allocated it, so a
+ * slot's balance can go negative; only the sum means anything. The peak
+ * shown is the sum of each thread's own peak, an upper bound.
+ * All formatting happens in the handler, which reads those atomics,
+ * converts numbers itself and calls write(2), so it is async-signal-safe.
+ * The fields are read without a lock and may be a moment apart.
+ */
+
+enum ProgressPhase {
+    PHASE_SETUP, PHASE_SERIES, PHASE_FINAL, PHASE_NEWTON, PHASE_EXTRACT,
+    PHASE_CF, PHASE_CONVERT, PHASE_OUTPUT, PHASE_COUNT
+};
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    "setup", "binary split", "final division", "Newton iteration",
+    "digit extraction", "continued fraction", "radix conversion", "output"
+};
+
+enum ProgressTask { TASK_IDLE, TASK_LEAF, TASK_MERGE, TASK_JOIN };
+
+static const char *const TASK_NAMES[] = { "idle", "leaf", "merge", "join" };
+
+// Threads listed in a snapshot; further workers still run, unlisted.
+static const unsigned PROGRESS_SLOTS = 64;
+
+// One cache line each: the owner thread writes its slot on every allocation.
+struct alignas(64) ProgressSlot {
+    std::atomic<bool>          used;
+    std::atomic<int>           task;
+    std::atomic<unsigned long> a, b;
+    std::atomic<std::int64_t>  gmp_live, gmp_peak;   // written by the owner only
+};
+
+// Zero-initialized as a static; std::atomic has a trivial default constructor.
+struct Progress {
+    std::atomic<std::int64_t>  run_start;      // ns, CLOCK_MONOTONIC
+    std::atomic<std::int64_t>  phase_start;
+    std::atomic<int>           phase;
+    std::atomic<std::int64_t>  phase_ns[PHASE_COUNT];
+    std::atomic<unsigned long> terms, terms_done;
+    std::atomic<std::uint64_t> to_write, written;
+    std::atomic<std::int64_t>  gmp_live, gmp_peak;   // threads without a slot
+    std::atomic<std::int64_t>  gmp_retired_live, gmp_retired_peak;   // detached slots, summed
+    ProgressSlot               slots[PROGRESS_SLOTS];
+};
+
+static_assert(std::atomic<std::int64_t>::is_always_lock_free &&
+              std::atomic<unsigned long>::is_always_lock_free,
+              "the snapshot handler needs lock-free atomics");
+
+static Progress progress;
+static thread_local int progress_slot = -1;
+
+static std::int64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void energy_sample(int phase);  // Energy accounting, below
+
+static void progress_phase(ProgressPhase phase) {
+    std::int64_t now = monotonic_ns();
+    int prev = progress.phase.load(std::memory_order_relaxed);
+    energy_sample(prev);
+    progress.phase_ns[prev].fetch_add(now - progress.phase_start.load(std::memory_order_relaxed),
+                                      std::memory_order_relaxed);
+    progress.phase_start.store(now, std::memory_order_relaxed);
+    progress.phase.store(phase, std::memory_order_relaxed);
+    PI_PROBE2(phase, static_cast<int>(phase), PHASE_NAMES[phase]);
+}
+
+/* Start a binary split over `terms` terms. */
+static void progress_series(unsigned long terms) {
+    progress.terms.store(terms, std::memory_order_relaxed);
+    progress.terms_done.store(0, std::memory_order_relaxed);
+    progress_phase(PHASE_SERIES);
+}
+
+/* Claim a slot for the calling thread (none left: it goes unlisted). */
+static void progress_attach() {
+    for (unsigned i = 0; i < PROGRESS_SLOTS; ++i) {
+        bool expected = false;
+        if (progress.slots[i].used.compare_exchange_strong(expected, true)) {
+            progress.slots[i].task.store(TASK_IDLE, std::memory_order_relaxed);
+            progress.slots[i].gmp_live.store(0, std::memory_order_relaxed);
+            progress.slots[i].gmp_peak.store(0, std::memory_order_relaxed);
+            progress_slot = static_cast<int>(i);
+            return;
+        }
     }
+}
 
-    // Print as 3.<digits>
-    std::cout << pi_str[0] << '.';
-    std::cout.write(pi_str.data() + 1, digits);
-    std::cout << '\n';
+/* Hand the slot back; its memory balance and peak move to the shared counters. */
+static void progress_detach() {
+    if (progress_slot < 0) return;
+    ProgressSlot &s = progress.slots[progress_slot];
+    progress.gmp_retired_live.fetch_add(s.gmp_live.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+    progress.gmp_retired_peak.fetch_add(s.gmp_peak.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+    s.gmp_live.store(0, std::memory_order_relaxed);
+    s.gmp_peak.store(0, std::memory_order_relaxed);
+    s.used.store(false);
+    progress_slot = -1;
+}
 
-    // Cleanup MPFR
-    mpfr_clear(sqrt10005);
-    mpfr_clear(num);
-    mpfr_clear(den);
-    mpfr_clear(pi);
-    mpfr_clear(scale);
-    mpfr_clear(pi_scaled);
-    mpfr_clear(pi_floor);
+static void progress_task(ProgressTask task, unsigned long a, unsigned long b) {
+    if (progress_slot < 0) return;
+    ProgressSlot &s = progress.slots[progress_slot];
+    s.a.store(a, std::memory_order_relaxed);
+    s.b.store(b, std::memory_order_relaxed);
+    s.task.store(task, std::memory_order_relaxed);
+}
 
-    return 0;
+/* Keep the range, change what the thread does with it. */
+static void progress_task(ProgressTask task) {
+    if (progress_slot >= 0) progress.slots[progress_slot].task.store(task, std::memory_order_relaxed);
+}
+
+/* GMP memory functions that keep live and peak byte counts. */
+static void progress_count(std::int64_t delta) {
+    const auto relaxed = std::memory_order_relaxed;
+    if (progress_slot < 0) {
+        // rare: threads past PROGRESS_SLOTS and the product workers
+        std::int64_t live = progress.gmp_live.fetch_add(delta, relaxed) + delta;
+        std::int64_t peak = progress.gmp_peak.load(relaxed);
+        while (live > peak && !progress.gmp_peak.compare_exchange_weak(peak, live, relaxed)) {
+        }
+        return;
+    }
+    // only this thread writes its slot: plain load and store, no locked RMW
+    ProgressSlot &s = progress.slots[progress_slot];
+    std::int64_t live = s.gmp_live.load(relaxed) + delta;
+    s.gmp_live.store(live, relaxed);
+    if (live > s.gmp_peak.load(relaxed)) s.gmp_peak.store(live, relaxed);
+}
+
+static void gmp_out_of_memory(std::size_t n) {
+    std::cerr << "GMP: cannot allocate " << n << " bytes\n";
+    std::abort();
+}
+
+static void *progress_alloc(std::size_t n) {
+    void *p = std::malloc(n);
+    if (!p) gmp_out_of_memory(n);
+    progress_count(static_cast<std::int64_t>(n));
+    return p;
+}
+
+static void *progress_realloc(void *p, std::size_t old_n, std::size_t n) {
+    void *q = std::realloc(p, n);
+    if (!q) gmp_out_of_memory(n);
+    progress_count(static_cast<std::int64_t>(n) - static_cast<std::int64_t>(old_n));
+    return q;
+}
+
+static void progress_free(void *p, std::size_t n) {
+    std::free(p);
+    progress_count(-static_cast<std::int64_t>(n));
+}
+
+/* Fixed buffer text building for the signal handler (no allocation, no stdio). */
+struct SignalText {
+    char        buf[8192];
+    std::size_t len = 0;
+
+    void put(char c) {
+        if (len < sizeof buf) buf[len++] = c;
+    }
+    void put(const char *s) {
+        while (*s) put(*s++);
+    }
+    void put_u(std::uint64_t v, int width = 1) {
+        char d[20];
+        int n = 0;
+        do {
+            d[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        while (n < width) d[n++] = '0';
+        while (n > 0) put(d[--n]);
+    }
+    void put_seconds(std::int64_t ns) {
+        if (ns < 0) ns = 0;
+        put_u(static_cast<std::uint64_t>(ns / 1000000000));
+        put('.');
+        put_u(static_cast<std::uint64_t>(ns / 1000000 % 1000), 3);
+        put(" s");
+    }
+    void put_mib(std::int64_t bytes) {
+        if (bytes < 0) bytes = 0;
+        std::uint64_t tenths = static_cast<std::uint64_t>(bytes) * 10 >> 20;
+        put_u(tenths / 10);
+        put('.');
+        put_u(tenths % 10);
+        put(" MiB");
+    }
+    void put_percent(std::uint64_t done, std::uint64_t total) {
+        std::uint64_t tenths = total ? done * 1000 / total : 0;
+        put_u(tenths / 10);
+        put('.');
+        put_u(tenths % 10);
+        put('%');
+    }
+};
+
+/* Depth of a node of `width` terms in a split over `terms` terms. */
+static unsigned split_depth(unsigned long terms, unsigned long width) {
+    unsigned depth = 0;
+    while (terms > width && width != 0) {
+        terms -= terms / 2;
+        ++depth;
+    }
+    return depth;
+}
+
+static void progress_snapshot(int) {
+    const int saved_errno = errno;
+    const auto relaxed = std::memory_order_relaxed;
+    std::int64_t now = monotonic_ns();
+    int phase = progress.phase.load(relaxed);
+    std::int64_t in_phase = now - progress.phase_start.load(relaxed);
+
+    SignalText out;
+    out.put("Snapshot: ");
+    out.put(PHASE_NAMES[phase]);
+    out.put(" for ");
+    out.put_seconds(in_phase);
+    out.put(", elapsed ");
+    out.put_seconds(now - progress.run_start.load(relaxed));
+    out.put("\n  phases:");
+    bool first = true;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        std::int64_t ns = progress.phase_ns[p].load(relaxed) + (p == phase ? in_phase : 0);
+        if (ns == 0 && p != phase) continue;
+        out.put(first ? " " : ", ");
+        out.put(PHASE_NAMES[p]);
+        out.put(' ');
+        out.put_seconds(ns);
+        first = false;
+    }
+    out.put('\n');
+
+    unsigned long terms = progress.terms.load(relaxed);
+    if (phase == PHASE_SERIES && terms != 0) {
+        unsigned long done = progress.terms_done.load(relaxed);
+        out.put("  binary split: ");
+        out.put_u(done);
+        out.put(" of ");
+        out.put_u(terms);
+        out.put(" terms summed (");
+        out.put_percent(done, terms);
+        out.put(")\n");
+        for (unsigned i = 0; i < PROGRESS_SLOTS; ++i) {
+            const ProgressSlot &s = progress.slots[i];
+            if (!s.used.load(relaxed)) continue;
+            int task = s.task.load(relaxed);
+            unsigned long a = s.a.load(relaxed), b = s.b.load(relaxed);
+            out.put("  thread ");
+            out.put_u(i);
+            out.put(": ");
+            out.put(TASK_NAMES[task]);
+            if (task != TASK_IDLE) {
+                out.put(" [");
+                out.put_u(a);
+                out.put(", ");
+                out.put_u(b);
+                out.put("), depth ");
+                out.put_u(split_depth(terms, b - a));
+            }
+            out.put('\n');
+        }
+    }
+    if (phase == PHASE_OUTPUT) {
+        out.put("  output: ");
+        out.put_u(progress.written.load(relaxed));
+        out.put(" of ");
+        out.put_u(progress.to_write.load(relaxed));
+        out.put(" digits written\n");
+    }
+    std::int64_t live = progress.gmp_live.load(relaxed) + progress.gmp_retired_live.load(relaxed);
+    std::int64_t peak = progress.gmp_peak.load(relaxed) + progress.gmp_retired_peak.load(relaxed);
+    for (unsigned i = 0; i < PROGRESS_SLOTS; ++i) {
+        live += progress.slots[i].gmp_live.load(relaxed);
+        peak += progress.slots[i].gmp_peak.load(relaxed);
+    }
+    out.put("  GMP memory: live ");
+    out.put_mib(live);
+    out.put(", peak at most ");
+    out.put_mib(std::max(peak, live));
+    out.put('\n');
+
+    const char *p = out.buf;
+    std::size_t left = out.len;
+    while (left > 0) {
+        ssize_t n = write(STDERR_FILENO, p, left);
+        if (n <= 0) break;
+        p += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    errno = saved_errno;
+}
+
+/* Start the clock, route GMP allocations through the counters and arm SIGUSR1. */
+static void progress_install() {
+    std::int64_t now = monotonic_ns();
+    progress.run_start.store(now);
+    progress.phase_start.store(now);
+    progress_attach();
+    mp_set_memory_functions(progress_alloc, progress_realloc, progress_free);
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof sa);
+    sa.sa_handler = progress_snapshot;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+}
+
+/* =========================
+   Energy accounting
+   ========================= */
+
+/*
+ * --energy reads the RAPL energy counters exposed by the powercap driver
+ * (/sys/class/powercap/intel-rapl:*, also used on AMD): every package
+ * domain and the DRAM subdomains where the platform has them. Counters
+ * are sampled at each phase change and once a second in between, and
+ * the difference is credited to the phase that was running. A counter
+ * that went backwards wrapped at max_energy_range_uj; the one-second
+ * samples keep a wrap from being missed even at several hundred watts.
+ * The counters are often readable by root only; then the run goes on
+ * without energy figures.
+ */
+
+struct RaplDomain {
+    std::string   path;   // directory holding energy_uj
+    bool          dram;   // else a package
+    std::uint64_t range;  // max_energy_range_uj
+    std::uint64_t last;   // previous energy_uj
+};
+
+struct EnergyMeter {
+    std::vector<RaplDomain> domains;
+    std::mutex              lock;
+    std::condition_variable wake;
+    bool                    stop = false;
+    std::thread             sampler;
+    double                  joules[PHASE_COUNT][2] = {};  // [phase][package, dram]
+};
+
+static EnergyMeter *energy_meter = nullptr;
+
+static bool read_counter(const std::string &path, std::uint64_t &value) {
+    std::string line;
+    if (!read_first_line(path, line) || line.empty() ||
+        !std::isdigit(static_cast<unsigned char>(line[0]))) {
+        return false;
+    }
+    value = std::strtoull(line.c_str(), nullptr, 10);
+    return true;
+}
+
+/* Credit the energy since the previous sample to `phase`. */
+static void energy_sample(int phase) {
+    EnergyMeter *m = energy_meter;
+    if (!m) return;
+    std::lock_guard<std::mutex> guard(m->lock);
+    for (RaplDomain &d : m->domains) {
+        std::uint64_t now;
+        if (!read_counter(d.path + "/energy_uj", now)) continue;
+        std::uint64_t delta = now >= d.last ? now - d.last : d.range - d.last + now;
+        d.last = now;
+        m->joules[phase][d.dram ? 1 : 0] += static_cast<double>(delta) * 1e-6;
+    }
+}
+
+/* Find the readable package and DRAM domains under /sys/class/powercap. */
+static std::vector<RaplDomain> find_rapl_domains(std::string &error) {
+    std::vector<RaplDomain> domains;
+    const std::string base = "/sys/class/powercap";
+    DIR *dir = opendir(base.c_str());
+    if (!dir) {
+        error = "no " + base;
+        return domains;
+    }
+    std::vector<std::string> entries;
+    while (dirent *e = readdir(dir)) {
+        if (std::strncmp(e->d_name, "intel-rapl:", 11) == 0) entries.push_back(e->d_name);
+    }
+    closedir(dir);
+    std::sort(entries.begin(), entries.end());
+
+    bool unreadable = false;
+    for (const std::string &entry : entries) {
+        RaplDomain d;
+        d.path = base + "/" + entry;
+        std::string name;
+        if (!read_first_line(d.path + "/name", name)) continue;
+        if (name.compare(0, 7, "package") == 0) d.dram = false;
+        else if (name == "dram") d.dram = true;
+        else continue;  // core, uncore and psys overlap the packages
+        if (!read_counter(d.path + "/max_energy_range_uj", d.range) ||
+            !read_counter(d.path + "/energy_uj", d.last)) {
+            unreadable = true;
+            continue;
+        }
+        domains.push_back(d);
+    }
+    if (domains.empty()) {
+        error = unreadable ? "RAPL counters in " + base + " are not readable (root only?)"
+                           : "no RAPL package domains in " + base;
+    }
+    return domains;
+}
+
+/* Start metering; false (with a note on stderr) when no counter is usable. */
+static bool energy_start() {
+    std::string error;
+    std::vector<RaplDomain> domains = find_rapl_domains(error);
+    if (domains.empty()) {
+        std::cerr << "Energy: " << error << ", not measuring\n";
+        return false;
+    }
+    EnergyMeter *m = new EnergyMeter;
+    m->domains = std::move(domains);
+    energy_meter = m;
+    m->sampler = std::thread([m] {
+        std::unique_lock<std::mutex> hold(m->lock);
+        while (!m->wake.wait_for(hold, std::chrono::seconds(1), [m] { return m->stop; })) {
+            hold.unlock();
+            energy_sample(progress.phase.load(std::memory_order_relaxed));
+            hold.lock();
+        }
+    });
+    return true;
+}
+
+/*
+ * Stop metering and print the energy per phase, with the phase times
+ * from the progress counters, and the total per output digit.
+ */
+static void energy_report(unsigned long digits, std::ostream &os) {
+    EnergyMeter *m = energy_meter;
+    if (!m) return;
+    int current = progress.phase.load();
+    energy_sample(current);
+    std::int64_t in_phase = monotonic_ns() - progress.phase_start.load();
+    {
+        std::lock_guard<std::mutex> guard(m->lock);
+        m->stop = true;
+    }
+    m->wake.notify_all();
+    m->sampler.join();
+    energy_meter = nullptr;
+
+    bool have_dram = false;
+    for (const RaplDomain &d : m->domains) have_dram = have_dram || d.dram;
+
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    double total[2] = {0, 0}, seconds = 0;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        std::int64_t ns = progress.phase_ns[p].load() + (p == current ? in_phase : 0);
+        double s = static_cast<double>(ns) * 1e-9;
+        double j = m->joules[p][0] + m->joules[p][1];
+        total[0] += m->joules[p][0];
+        total[1] += m->joules[p][1];
+        seconds += s;
+        if (p == PHASE_SETUP || (j == 0 && s < 0.0005)) continue;
+        out.precision(3);
+        out << "  " << PHASE_NAMES[p] << ": " << s << " s, ";
+        out.precision(1);
+        out << j << " J, " << (s > 0 ? j / s : 0.0) << " W\n";
+    }
+    double joules = total[0] + total[1];
+    os.setf(std::ios::fixed);
+    std::streamsize old_precision = os.precision(1);
+    os << "Energy: " << joules << " J (package " << total[0] << " J";
+    if (have_dram) os << ", dram " << total[1] << " J";
+    os << "), average " << (seconds > 0 ? joules / seconds : 0.0) << " W";
+    os.precision(3);
+    if (digits != 0) os << ", " << joules / static_cast<double>(digits) * 1e6 << " uJ per digit";
+    os << "\n" << out.str();
+    os.unsetf(std::ios::fixed);
+    os.precision(old_precision);
+    delete m;
+}
+
+/* Reports (and stops) the meter however main returns. */
+struct EnergyGuard {
+    unsigned long digits = 0;        // for the per-digit figure; 0 leaves it out
+    std::ostream *out = &std::cout;  // stderr where stdout carries generated output
+
+    ~EnergyGuard() { energy_report(digits, *out); }
+};
+
+/* =========================
+   Parallel multiplication
+   ========================= */
+
+/*
+ * GMP multiplies on one thread, so the top merges of the split, where
+ * the operands are largest and the other workers have run out of work,
+ * were serial. parallel_mul splits one product into independent block
+ * products, runs those on threads with mpz_mul and adds them into the
+ * result limbs at their offsets:
+ *
+ *   unbalanced (xn >= 2 yn)  x in blocks of about yn limbs, each times y
+ *   5 threads or more        Toom-3: 5 products of a third of the size
+ *   otherwise                Karatsuba: 3 products of half the size
+ *
+ * Each block product gets a share of the threads and splits again when
+ * that share is 2 or more, so every thread count keeps busy. A square
+ * (x and y the same object) evaluates one side only and squares the
+ * pieces, so GMP's squaring still applies. Operands below
+ * PARALLEL_MUL_MIN_LIMBS are not worth the extra linear passes.
+ */
+
+// Products whose smaller operand is shorter than this stay on one thread.
+static const std::size_t PARALLEL_MUL_MIN_LIMBS = 1 << 14;
+
+/* Read-only view of limbs [from, from + len) of |x|, clipped to its size. */
+static void limb_view(mpz_ptr view, mpz_srcptr x, std::size_t from, std::size_t len) {
+    const mp_limb_t *d = mpz_limbs_read(x);
+    std::size_t n = mpz_size(x);
+    if (from >= n) {
+        mpz_roinit_n(view, d, 0);
+        return;
+    }
+    len = std::min(len, n - from);
+    while (len > 0 && d[from + len - 1] == 0) --len;
+    mpz_roinit_n(view, d + from, static_cast<mp_size_t>(len));
+}
+
+/* Zeroed room for an rn-limb result in r. */
+static mp_limb_t *sum_begin(mpz_class &r, std::size_t rn) {
+    mp_limb_t *d = mpz_limbs_write(r.get_mpz_t(), static_cast<mp_size_t>(rn));
+    std::fill(d, d + rn, 0);
+    return d;
+}
+
+/* d[off .. rn) += v, v >= 0. Every part of a product fits below rn, so
+ * the sum never carries out. */
+static void sum_add(mp_limb_t *d, std::size_t rn, const mpz_class &v, std::size_t off) {
+    std::size_t vn = mpz_size(v.get_mpz_t());
+    if (vn == 0) return;
+    mpn_add(d + off, d + off, static_cast<mp_size_t>(rn - off), mpz_limbs_read(v.get_mpz_t()),
+            static_cast<mp_size_t>(vn));
+}
+
+static void parallel_mul(mpz_ptr r, mpz_srcptr x, mpz_srcptr y, unsigned threads);
+
+/* Run every job, handing out `threads` in waves of at most `threads`
+ * jobs; a job gets its share of the wave's threads as argument. */
+template <class Job>
+static void run_jobs(std::vector<Job> &jobs, unsigned threads) {
+    for (std::size_t first = 0; first < jobs.size(); first += threads) {
+        std::size_t n = std::min<std::size_t>(threads, jobs.size() - first);
+        std::vector<std::thread> pool;
+        for (std::size_t i = 0; i < n; ++i) {
+            unsigned share = static_cast<unsigned>(threads / n + (i < threads % n ? 1 : 0));
+            Job &job = jobs[first + i];
+            if (i + 1 == n) {
+                job(share);
+            } else {
+                pool.emplace_back([&job, share] { job(share); });
+            }
+        }
+        for (std::thread &t : pool) t.join();
+    }
+}
+
+/* One block product of parallel_mul: out = a * b. */
+struct MulJob {
+    mpz_srcptr a, b;
+    mpz_class *out;
+    void operator()(unsigned threads) const { parallel_mul(out->get_mpz_t(), a, b, threads); }
+};
+
+/* |x| * |y| for xn >= 2 yn: x in blocks against all of y. */
+static void parallel_mul_blocks(mpz_class &r, mpz_srcptr x, mpz_srcptr y, unsigned threads) {
+    std::size_t xn = mpz_size(x), yn = mpz_size(y);
+    std::size_t k = std::min<std::size_t>(threads, xn / yn);
+    std::size_t block = (xn + k - 1) / k;
+
+    std::vector<__mpz_struct> xs(k);
+    mpz_t ys;
+    limb_view(ys, y, 0, yn);
+    std::vector<mpz_class> part(k);
+    std::vector<MulJob> jobs;
+    for (std::size_t i = 0; i < k; ++i) {
+        limb_view(&xs[i], x, i * block, block);
+        jobs.push_back({&xs[i], ys, &part[i]});
+    }
+    run_jobs(jobs, threads);
+
+    mp_limb_t *d = sum_begin(r, xn + yn);
+    for (std::size_t i = 0; i < k; ++i) sum_add(d, xn + yn, part[i], i * block);
+    mpz_limbs_finish(r.get_mpz_t(), static_cast<mp_size_t>(xn + yn));
+}
+
+/* |x| * |y| with x and y split in halves of h limbs. */
+static void parallel_mul_karatsuba(mpz_class &r, mpz_srcptr x, mpz_srcptr y, unsigned threads) {
+    const bool square = x == y;
+    const std::size_t rn = mpz_size(x) + mpz_size(y);
+    std::size_t h = (std::max(mpz_size(x), mpz_size(y)) + 1) / 2;
+    mpz_t x0, x1, y0, y1;
+    limb_view(x0, x, 0, h);
+    limb_view(x1, x, h, h);
+    limb_view(y0, y, 0, h);
+    limb_view(y1, y, h, h);
+
+    mpz_class s, t, z0, z1, z2;
+    mpz_add(s.get_mpz_t(), x0, x1);
+    if (!square) mpz_add(t.get_mpz_t(), y0, y1);
+    mpz_srcptr b0 = square ? x0 : y0, b1 = square ? x1 : y1;
+    mpz_srcptr bs = square ? s.get_mpz_t() : t.get_mpz_t();
+    std::vector<MulJob> jobs = {
+        {x0, b0, &z0}, {x1, b1, &z2}, {s.get_mpz_t(), bs, &z1},
+    };
+    run_jobs(jobs, threads);
+
+    // x * y = z0 + (z1 - z0 - z2) B + z2 B^2
+    z1 -= z0;
+    z1 -= z2;
+    mp_limb_t *d = sum_begin(r, rn);
+    sum_add(d, rn, z0, 0);
+    sum_add(d, rn, z1, h);
+    sum_add(d, rn, z2, 2 * h);
+    mpz_limbs_finish(r.get_mpz_t(), static_cast<mp_size_t>(rn));
+}
+
+/* |x| * |y| with x and y split in thirds of h limbs, evaluated at
+ * 0, 1, -1, -2 and infinity (Bodrato's interpolation sequence). */
+static void parallel_mul_toom3(mpz_class &r, mpz_srcptr x, mpz_srcptr y, unsigned threads) {
+    const bool square = x == y;
+    const std::size_t rn = mpz_size(x) + mpz_size(y);
+    std::size_t h = (std::max(mpz_size(x), mpz_size(y)) + 2) / 3;
+    mpz_t xv[3], yv[3];
+    for (std::size_t i = 0; i < 3; ++i) {
+        limb_view(xv[i], x, i * h, h);
+        limb_view(yv[i], y, i * h, h);
+    }
+
+    // v(1) = v0 + v1 + v2, v(-1) = v0 - v1 + v2, v(-2) = 2 (v(-1) + v2) - v0
+    mpz_class x1, xm1, xm2, y1, ym1, ym2;
+    for (int side = 0; side < (square ? 1 : 2); ++side) {
+        mpz_t *v = side ? yv : xv;
+        mpz_class &p1 = side ? y1 : x1, &m1 = side ? ym1 : xm1, &m2 = side ? ym2 : xm2;
+        mpz_class even;
+        mpz_add(even.get_mpz_t(), v[0], v[2]);
+        mpz_add(p1.get_mpz_t(), even.get_mpz_t(), v[1]);
+        mpz_sub(m1.get_mpz_t(), even.get_mpz_t(), v[1]);
+        mpz_add(m2.get_mpz_t(), m1.get_mpz_t(), v[2]);
+        m2 <<= 1;
+        mpz_sub(m2.get_mpz_t(), m2.get_mpz_t(), v[0]);
+    }
+
+    // a square multiplies each x-side value by itself
+    mpz_class &b1 = square ? x1 : y1, &bm1 = square ? xm1 : ym1, &bm2 = square ? xm2 : ym2;
+    mpz_t *bv = square ? xv : yv;
+    mpz_class r0, p1, pm1, pm2, r4;
+    std::vector<MulJob> jobs = {
+        {xv[0], bv[0], &r0},
+        {x1.get_mpz_t(), b1.get_mpz_t(), &p1},
+        {xm1.get_mpz_t(), bm1.get_mpz_t(), &pm1},
+        {xm2.get_mpz_t(), bm2.get_mpz_t(), &pm2},
+        {xv[2], bv[2], &r4},
+    };
+    run_jobs(jobs, threads);
+
+    mpz_class r1, r2, r3;
+    r3 = pm2 - p1;
+    mpz_divexact_ui(r3.get_mpz_t(), r3.get_mpz_t(), 3);
+    r1 = p1 - pm1;
+    mpz_divexact_ui(r1.get_mpz_t(), r1.get_mpz_t(), 2);
+    r2 = pm1 - r0;
+    r3 = r2 - r3;
+    mpz_divexact_ui(r3.get_mpz_t(), r3.get_mpz_t(), 2);
+    r3 += 2 * r4;
+    r2 += r1;
+    r2 -= r4;
+    r1 -= r3;
+
+    // r0 .. r4 are the coefficients of x(t) y(t), all non-negative
+    mp_limb_t *d = sum_begin(r, rn);
+    sum_add(d, rn, r0, 0);
+    sum_add(d, rn, r1, h);
+    sum_add(d, rn, r2, 2 * h);
+    sum_add(d, rn, r3, 3 * h);
+    sum_add(d, rn, r4, 4 * h);
+    mpz_limbs_finish(r.get_mpz_t(), static_cast<mp_size_t>(rn));
+}
+
+/* r = x * y on up to `threads` threads (r may alias x or y). */
+static void parallel_mul(mpz_ptr r, mpz_srcptr x, mpz_srcptr y, unsigned threads) {
+    std::size_t xn = mpz_size(x), yn = mpz_size(y);
+    if (threads < 2 || std::min(xn, yn) < PARALLEL_MUL_MIN_LIMBS) {
+        mpz_mul(r, x, y);
+        return;
+    }
+    if (xn < yn) {
+        std::swap(x, y);
+        std::swap(xn, yn);
+    }
+    if (x != y && mpz_cmp(x, y) == 0) y = x;  // equal values square too
+
+    mpz_class out;
+    if (xn >= 2 * yn) {
+        parallel_mul_blocks(out, x, y, threads);
+    } else if (threads >= 5) {
+        parallel_mul_toom3(out, x, y, threads);
+    } else {
+        parallel_mul_karatsuba(out, x, y, threads);
+    }
+    if ((mpz_sgn(x) < 0) != (mpz_sgn(y) < 0)) out = -out;
+    mpz_swap(r, out.get_mpz_t());
+}
+
+static void trace_mul(std::uint64_t xn, std::uint64_t yn);
+
+/* out = a * b in MPFR, through parallel_mul on the mantissas once the
+ * precision makes that pay; rounds once, exactly like mpfr_mul. */
+static void parallel_mpfr_mul(mpfr_t out, mpfr_t a, mpfr_t b, unsigned threads) {
+    PI_PROBE2(mul__start, prec_limbs(mpfr_get_prec(a)), prec_limbs(mpfr_get_prec(b)));
+    trace_mul(prec_limbs(mpfr_get_prec(a)), prec_limbs(mpfr_get_prec(b)));
+    if (threads < 2 || mpfr_get_prec(out) < static_cast<mpfr_prec_t>(PARALLEL_MUL_MIN_LIMBS * GMP_NUMB_BITS) ||
+        !mpfr_regular_p(a) || !mpfr_regular_p(b)) {
+        mpfr_mul(out, a, b, MPFR_RNDN);
+    } else {
+        mpz_class ma, mb;
+        mpfr_exp_t ea = mpfr_get_z_2exp(ma.get_mpz_t(), a);
+        mpfr_exp_t eb = a == b ? ea : mpfr_get_z_2exp(mb.get_mpz_t(), b);
+        parallel_mul(ma.get_mpz_t(), ma.get_mpz_t(), a == b ? ma.get_mpz_t() : mb.get_mpz_t(), threads);
+        mpfr_set_z_2exp(out, ma.get_mpz_t(), ea + eb, MPFR_RNDN);
+    }
+    PI_PROBE1(mul__done, prec_limbs(mpfr_get_prec(out)));
+}
+
+/* out = x^e by left-to-right square-and-multiply on parallel_mpfr_mul
+ * (out may alias x); a few roundings more than mpfr_pow_ui. */
+static void parallel_mpfr_pow_ui(mpfr_t out, mpfr_t x, unsigned long e, unsigned threads) {
+    if (e == 0) {
+        mpfr_set_ui(out, 1UL, MPFR_RNDN);
+        return;
+    }
+    mpfr_t base;
+    mpfr_init2(base, mpfr_get_prec(x));
+    mpfr_set(base, x, MPFR_RNDN);
+    mpfr_set(out, base, MPFR_RNDN);
+    for (int bit = 62 - __builtin_clzl(e); bit >= 0; --bit) {
+        parallel_mpfr_mul(out, out, out, threads);
+        if ((e >> bit) & 1UL) parallel_mpfr_mul(out, out, base, threads);
+    }
+    mpfr_clear(base);
+}
+
+/* =========================
+   Multiplication trace
+   ========================= */
+
+/*
+ * --trace-mul FILE records the big multiplications of a run, in the
+ * order they start, with their operand sizes and the phase they belong
+ * to. --replay FILE runs exactly that sequence of products on random
+ * operands with every backend in MUL_BACKENDS, so a new multiplication
+ * routine can be compared on the real workload without a full run.
+ *
+ * Only products whose smaller operand has TRACE_MIN_LIMBS limbs or more
+ * are kept: the leaves multiply by one- and two-limb term factors by the
+ * million, and those products say nothing about a backend.
+ *
+ * File layout: "PIMTRC01", then per product the two limb counts as
+ * LEB128 varints (larger first) and the phase as one byte.
+ */
+
+static const char TRACE_MAGIC[8] = {'P', 'I', 'M', 'T', 'R', 'C', '0', '1'};
+static const std::uint64_t TRACE_MIN_LIMBS = 16;
+
+struct TraceRecord {
+    std::uint64_t xn, yn;   // xn >= yn
+    unsigned char phase;
+};
+
+static bool trace_recording = false;
+static std::mutex trace_lock;
+static std::vector<TraceRecord> trace_records;
+
+static void trace_mul(std::uint64_t xn, std::uint64_t yn) {
+    if (!trace_recording) return;
+    if (xn < yn) std::swap(xn, yn);
+    if (yn < TRACE_MIN_LIMBS) return;
+    TraceRecord r{xn, yn, static_cast<unsigned char>(progress.phase.load(std::memory_order_relaxed))};
+    std::lock_guard<std::mutex> guard(trace_lock);
+    trace_records.push_back(r);
+}
+
+static void put_varint(std::string &out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static bool get_varint(const unsigned char *&p, const unsigned char *end, std::uint64_t &v) {
+    v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static int write_mul_trace(const std::string &path) {
+    std::string data(TRACE_MAGIC, sizeof TRACE_MAGIC);
+    for (const TraceRecord &r : trace_records) {
+        put_varint(data, r.xn);
+        put_varint(data, r.yn);
+        data += static_cast<char>(r.phase);
+    }
+    std::ofstream out(path, std::ios::binary);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out) {
+        std::cerr << "Cannot write " << path << "\n";
+        return 1;
+    }
+    std::cout << "Trace: " << trace_records.size() << " multiplications ("
+              << data.size() << " bytes) written to " << path << "\n";
+    if (trace_records.empty()) {
+        std::cout << "Trace: no product of this run had " << TRACE_MIN_LIMBS
+                  << " limbs or more on both sides (small runs use the mpn path)\n";
+    }
+    return 0;
+}
+
+static bool read_mul_trace(const std::string &path, std::vector<TraceRecord> &records) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!in.good() && !in.eof()) {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
+    }
+    if (data.size() < sizeof TRACE_MAGIC ||
+        std::memcmp(data.data(), TRACE_MAGIC, sizeof TRACE_MAGIC) != 0) {
+        std::cerr << path << " is not a multiplication trace\n";
+        return false;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data()) + sizeof TRACE_MAGIC;
+    const unsigned char *end = reinterpret_cast<const unsigned char *>(data.data()) + data.size();
+    while (p < end) {
+        TraceRecord r;
+        if (!get_varint(p, end, r.xn) || !get_varint(p, end, r.yn) || p >= end ||
+            *p >= PHASE_COUNT || r.xn < r.yn || r.yn == 0) {
+            std::cerr << path << ": corrupt record " << records.size() << "\n";
+            return false;
+        }
+        r.phase = *p++;
+        records.push_back(r);
+    }
+    return true;
+}
+
+/*
+ * A multiplication backend: r[0 .. xn+yn) = x * y for xn >= yn > 0, r
+ * overlapping neither. `threads` is the number of threads it may use.
+ */
+struct MulBackend {
+    const char *name;
+    void (*mul)(mp_limb_t *r, const mp_limb_t *x, mp_size_t xn,
+                const mp_limb_t *y, mp_size_t yn, unsigned threads);
+};
+
+static void mul_gmp(mp_limb_t *r, const mp_limb_t *x, mp_size_t xn,
+                    const mp_limb_t *y, mp_size_t yn, unsigned) {
+    mpn_mul(r, x, xn, y, yn);
+}
+
+/* Unbalanced products as yn x yn blocks, summed into place. */
+static void mul_balanced(mp_limb_t *r, const mp_limb_t *x, mp_size_t xn,
+                         const mp_limb_t *y, mp_size_t yn, unsigned) {
+    if (xn < 2 * yn) {
+        mpn_mul(r, x, xn, y, yn);
+        return;
+    }
+    std::vector<mp_limb_t> block(2 * yn);
+    mpn_mul_n(r, x, y, yn);
+    std::fill(r + 2 * yn, r + xn + yn, 0);
+    for (mp_size_t off = yn; off < xn; off += yn) {
+        mp_size_t len = std::min(yn, xn - off);
+        mpn_mul(block.data(), y, yn, x + off, len);
+        mpn_add(r + off, r + off, xn + yn - off, block.data(), yn + len);
+    }
+}
+
+/* parallel_mul on read-only views of the operands. */
+static void mul_parallel(mp_limb_t *r, const mp_limb_t *x, mp_size_t xn,
+                         const mp_limb_t *y, mp_size_t yn, unsigned threads) {
+    mpz_t xv, yv;
+    mpz_roinit_n(xv, x, xn);
+    mpz_roinit_n(yv, y, yn);
+    mpz_class prod;
+    parallel_mul(prod.get_mpz_t(), xv, yv, threads);
+    mp_size_t n = static_cast<mp_size_t>(mpz_size(prod.get_mpz_t()));
+    std::copy(mpz_limbs_read(prod.get_mpz_t()), mpz_limbs_read(prod.get_mpz_t()) + n, r);
+    std::fill(r + n, r + xn + yn, 0);
+}
+
+/* Fold all n limbs of a product into h (FNV-1a over whole limbs). */
+static std::uint64_t hash_limbs(std::uint64_t h, const mp_limb_t *p, std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static const MulBackend MUL_BACKENDS[] = {
+    { "gmp",      mul_gmp      },
+    { "balanced", mul_balanced },
+    { "parallel", mul_parallel },
+};
+
+static int replay_mul_trace(const std::string &path, unsigned threads) {
+    std::vector<TraceRecord> records;
+    if (!read_mul_trace(path, records)) return 1;
+    if (records.empty()) {
+        std::cout << "Replay: " << path << " holds no multiplications\n";
+        return 0;
+    }
+
+    std::uint64_t max_x = 0, max_y = 0, limbs = 0;
+    for (const TraceRecord &r : records) {
+        max_x = std::max(max_x, r.xn);
+        max_y = std::max(max_y, r.yn);
+        limbs += r.xn + r.yn;
+    }
+    // Random operands (xorshift), shared by every record and backend.
+    std::vector<mp_limb_t> x(max_x), y(max_y), prod(max_x + max_y);
+    std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (std::vector<mp_limb_t> *v : {&x, &y}) {
+        for (mp_limb_t &limb : *v) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            limb = state | 1;
+        }
+    }
+
+    const std::size_t nb = sizeof MUL_BACKENDS / sizeof MUL_BACKENDS[0];
+    std::vector<std::uint64_t> phase_count(PHASE_COUNT), class_count(COST_CLASSES);
+    std::vector<double> phase_s(nb * PHASE_COUNT), class_s(nb * COST_CLASSES), total(nb);
+    std::vector<std::uint64_t> check(nb, 0xCBF29CE484222325ULL);
+    for (const TraceRecord &r : records) {
+        unsigned cls = 0;
+        while (cls + 1 < COST_CLASSES && (r.yn >> (cls + 1)) != 0) ++cls;
+        ++phase_count[r.phase];
+        ++class_count[cls];
+    }
+
+    std::cout << "Replay: " << records.size() << " multiplications from " << path
+              << " (" << limbs << " operand limbs), " << threads
+              << (threads == 1 ? " thread\n" : " threads\n");
+    for (std::size_t b = 0; b < nb; ++b) {
+        for (const TraceRecord &r : records) {
+            unsigned cls = 0;
+            while (cls + 1 < COST_CLASSES && (r.yn >> (cls + 1)) != 0) ++cls;
+            auto t0 = std::chrono::steady_clock::now();
+            MUL_BACKENDS[b].mul(prod.data(), x.data(), static_cast<mp_size_t>(r.xn),
+                                y.data(), static_cast<mp_size_t>(r.yn), threads);
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            total[b] += s;
+            phase_s[b * PHASE_COUNT + r.phase] += s;
+            class_s[b * COST_CLASSES + cls] += s;
+            check[b] = hash_limbs(check[b], prod.data(), r.xn + r.yn);
+        }
+    }
+
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    auto columns = [&](const std::vector<double> &secs, std::size_t stride, std::size_t i) {
+        for (std::size_t b = 0; b < nb; ++b) {
+            out << (b ? ", " : "") << MUL_BACKENDS[b].name << ' ' << secs[b * stride + i] << " s";
+        }
+        out << '\n';
+    };
+    for (std::size_t b = 0; b < nb; ++b) {
+        out << "  " << MUL_BACKENDS[b].name << ": " << total[b] << " s";
+        if (b != 0) out << " (" << total[b] / total[0] << "x gmp)";
+        out << '\n';
+    }
+    for (unsigned p = 0; p < PHASE_COUNT; ++p) {
+        if (phase_count[p] == 0) continue;
+        out << "  " << PHASE_NAMES[p] << ": " << phase_count[p] << " x, ";
+        columns(phase_s, PHASE_COUNT, p);
+    }
+    for (unsigned c = 0; c < COST_CLASSES; ++c) {
+        if (class_count[c] == 0) continue;
+        out << "  mul " << (1ULL << c) << ".." << (2ULL << c) - 1 << " limbs: " << class_count[c] << " x, ";
+        columns(class_s, COST_CLASSES, c);
+    }
+    std::cout << out.str();
+
+    for (std::size_t b = 1; b < nb; ++b) {
+        if (check[b] != check[0]) {
+            std::cerr << "Replay: backend " << MUL_BACKENDS[b].name << " gives different products\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* =========================
+   Multiplication layer
+   ========================= */
+
+/*
+ * The products and sums of the engine go through here, so --cost,
+ * --trace-mul and the USDT probes see each of them once.
+ */
+
+/* r = x * y for the products of the engine (r may alias x or y), on up
+ * to `threads` threads. Counted once however parallel_mul splits it. */
+static void big_mul(mpz_class &r, const mpz_class &x, const mpz_class &y,
+                    unsigned threads = 1) {
+    PI_PROBE2(mul__start, mpz_size(x.get_mpz_t()), mpz_size(y.get_mpz_t()));
+    cost_mul(mpz_size(x.get_mpz_t()), mpz_size(y.get_mpz_t()));
+    trace_mul(mpz_size(x.get_mpz_t()), mpz_size(y.get_mpz_t()));
+    parallel_mul(r.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t(), threads);
+    PI_PROBE1(mul__done, mpz_size(r.get_mpz_t()));
+}
+
+/* r = x + y (r may alias x or y). */
+static void big_add(mpz_class &r, const mpz_class &x, const mpz_class &y) {
+    cost_add(std::max(mpz_size(x.get_mpz_t()), mpz_size(y.get_mpz_t())));
+    mpz_add(r.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t());
+}
+
+/* =========================
+   Hypergeometric binary split
+   ========================= */
+
+/*
+ * Generic binary-splitting engine for rapidly converging series
+ *
+ *   S = sum_{k>=0} a(k) * (p(0) ... p(k)) / (q(0) ... q(k))
+ *
+ * where the denominators have the structured form q(k) = c * r(k)^e.
+ * The term generators come from a Series type:
+ *
+ *   static void p(unsigned long k, mpz_class &out);
+ *   static void q_base(unsigned long k, mpz_class &out);   // r(k)
+ *   static const unsigned long q_power;                    // e
+ *   static const unsigned long q_scale;                    // c
+ *   static void a(unsigned long k, mpz_class &out);
+ *
+ * (plus terms(digits) and finish(out, P, Q, T, threads) for the final stage).
+ *
+ * binary_split<Series>(a, b, P, Q, T) computes
+ *   P(a, b) = p(a) ... p(b-1)
+ *   Q(a, b) = q(a) ... q(b-1) = c^(b-a) * (r(a) ... r(b-1))^e
+ *   T(a, b) = Q(a, b) * sum_{k=a}^{b-1} a(k) * p(a)...p(k) / (q(a)...q(k))
+ * so that S = T(0, N) / Q(0, N).
+ *
+ * Internally a node carries F(a, b) = r(a) ... r(b-1) instead of Q:
+ * merging F is a product of numbers e times shorter, and Q(m, b) is only
+ * formed where the merge formula needs it, as F^e times c^(b-m). The
+ * powers of c are computed once per split, before it forks: node sizes
+ * take at most two values per level, and each power is the square of
+ * one from the level below, times c when the size is odd.
+ *
+ * Ranges of at most SPLIT_LEAF_TERMS terms are accumulated in a loop
+ * instead of recursing, and the top of the tree is spread over up to
+ * `workers` threads, so every series gets the same schedule as pi.
+ */
+
+// Ranges this small are summed term by term (leaf batching).
+static const unsigned long SPLIT_LEAF_TERMS = 16;
+
+// Ranges smaller than this are never handed to another thread.
+static const unsigned long SPLIT_PARALLEL_MIN_TERMS = 2048;
+
+// c^n for the node sizes n of one split; read-only once the split forks.
+typedef std::map<unsigned long, mpz_class> QScalePowers;
+
+/* Fill `powers` for every node size of a split over n terms. */
+template <class Series>
+static void q_scale_powers(unsigned long n, QScalePowers &powers, unsigned workers) {
+    powers.clear();
+    if (Series::q_scale == 1) return;
+
+    // sizes of the nodes that merge, and of their halves
+    std::set<unsigned long> sizes;
+    std::vector<unsigned long> level(1, n);
+    while (!level.empty()) {
+        std::vector<unsigned long> next;
+        for (unsigned long s : level) {
+            if (!sizes.insert(s).second || s <= SPLIT_LEAF_TERMS) continue;
+            next.push_back(s / 2);
+            next.push_back(s - s / 2);
+        }
+        level.swap(next);
+    }
+
+    const mpz_class c = Series::q_scale;
+    for (unsigned long s : sizes) {
+        mpz_class &x = powers[s];
+        auto half = powers.find(s / 2);
+        if (s > 1 && half != powers.end()) {
+            big_mul(x, half->second, half->second, workers);
+            if (s % 2) big_mul(x, x, c);
+        } else {
+            mpz_pow_ui(x.get_mpz_t(), c.get_mpz_t(), s);
+        }
+    }
+}
+
+/* Q(a, b) = c^(b-a) * F(a, b)^e */
+template <class Series>
+static void q_from_factor(unsigned long n, const mpz_class &F, mpz_class &Q,
+                          const QScalePowers &powers, unsigned workers) {
+    if (Series::q_power == 1) {
+        Q = F;
+    } else if (mpz_size(F.get_mpz_t()) >= PARALLEL_MUL_MIN_LIMBS) {
+        // F^e as e - 1 products, so the power uses the idle workers too
+        big_mul(Q, F, F, workers);
+        for (unsigned long i = 2; i < Series::q_power; ++i) big_mul(Q, Q, F, workers);
+    } else {
+        cost_pow(mpz_sizeinbase(F.get_mpz_t(), 2), Series::q_power);
+        mpz_pow_ui(Q.get_mpz_t(), F.get_mpz_t(), Series::q_power);
+    }
+    if (Series::q_scale != 1) {
+        big_mul(Q, Q, powers.at(n), workers);
+    }
+}
+
+/* q(k) = c * r(k)^e */
+template <class Series>
+static void q_term(unsigned long k, mpz_class &r, mpz_class &q) {
+    Series::q_base(k, r);
+    if (Series::q_power == 1) {
+        q = r;
+    } else {
+        mpz_pow_ui(q.get_mpz_t(), r.get_mpz_t(), Series::q_power);
+    }
+    q *= Series::q_scale;
+}
+
+template <class Series>
+static void split_leaf(unsigned long a, unsigned long b,
+                       mpz_class &P, mpz_class &F, mpz_class &T, mpz_class *Q) {
+    mpz_class p, q, r, t;
+    Series::p(a, P);
+    q_term<Series>(a, F, q);
+    Series::a(a, T);
+    big_mul(T, T, P);
+    if (Q) *Q = q;
+
+    // Append one term at a time:
+    //   P' = P * p(k),  T' = T * q(k) + a(k) * P',  F' = F * r(k)
+    for (unsigned long k = a + 1; k < b; ++k) {
+        Series::p(k, p);
+        q_term<Series>(k, r, q);
+        Series::a(k, t);
+
+        big_mul(P, P, p);
+        big_mul(t, t, P);
+        big_mul(T, T, q);
+        big_add(T, T, t);
+        big_mul(F, F, r);
+        if (Q) big_mul(*Q, *Q, q);
+    }
+}
+
+/* Run left(workers) and right(workers), the left one on a new thread
+ * when there are workers to spare and the range is worth it. */
+template <class Left, class Right>
+static void split_fork(unsigned workers, unsigned long terms, Left left, Right right) {
+    if (workers > 1 && terms >= SPLIT_PARALLEL_MIN_TERMS) {
+        unsigned left_workers = workers / 2;
+        std::thread t([&] {
+            progress_attach();
+            left(left_workers);
+            progress_detach();
+        });
+        right(workers - left_workers);
+        progress_task(TASK_JOIN);
+        t.join();
+    } else {
+        left(1);
+        right(1);
+    }
+}
+
+/* One node: P, F and T always, Q(a, b) only when Q is non-null. */
+template <class Series>
+static void split_node(unsigned long a, unsigned long b,
+                       mpz_class &P, mpz_class &F, mpz_class &T, mpz_class *Q,
+                       const QScalePowers &powers, unsigned workers) {
+    if (b - a <= SPLIT_LEAF_TERMS) {
+        progress_task(TASK_LEAF, a, b);
+        split_leaf<Series>(a, b, P, F, T, Q);
+        progress.terms_done.fetch_add(b - a, std::memory_order_relaxed);
+        return;
+    }
+
+    unsigned long m = (a + b) / 2;
+
+    mpz_class P1, F1, T1;
+    mpz_class P2, F2, T2, Q2;
+
+    split_fork(workers, b - a,
+        [&](unsigned w) { split_node<Series>(a, m, P1, F1, T1, nullptr, powers, w); },
+        [&](unsigned w) { split_node<Series>(m, b, P2, F2, T2, &Q2, powers, w); });
+    progress_task(TASK_MERGE, a, b);
+    PI_PROBE4(merge__start, a, b, mpz_size(T1.get_mpz_t()), mpz_size(T2.get_mpz_t()));
+
+    // Both halves are done, so this node's workers are free for the
+    // products; only the top levels are large enough to use them.
+    // T(a, b) = Q(m, b) * T(a, m) + P(a, m) * T(m, b)
+    big_mul(T, Q2, T1, workers);
+    big_mul(T1, P1, T2, workers);
+    big_add(T, T, T1);
+
+    // P(a, b) = P(a, m) * P(m, b)
+    // F(a, b) = F(a, m) * F(m, b)
+    big_mul(P, P1, P2, workers);
+    big_mul(F, F1, F2, workers);
+
+    if (Q) q_from_factor<Series>(b - a, F, *Q, powers, workers);
+    PI_PROBE3(merge__done, a, b, mpz_size(T.get_mpz_t()));
+}
+
+template <class Series>
+static void binary_split(unsigned long a, unsigned long b,
+                         mpz_class &P, mpz_class &Q, mpz_class &T,
+                         unsigned workers = 1) {
+    mpz_class F;
+    QScalePowers powers;
+    q_scale_powers<Series>(b - a, powers, workers);
+    split_node<Series>(a, b, P, F, T, &Q, powers, workers);
+}
+
+/* =========================
+   Truncated merging
+   ========================= */
+
+/*
+ * Near the root P, Q and T grow far beyond the precision the final
+ * quotient needs. With --truncate, nodes whose exact result would exceed
+ * the working precision w (target + guard bits) merge truncated
+ * big-floats instead: value = man * 2^exp with |man| < 2^w.
+ *
+ * Each value tracks a bound on its relative error in units of
+ * u = 2^-(w-1): truncating a mantissa adds 1, a product adds the
+ * operands' bounds (second-order terms are far below u), and a sum
+ * weighs each operand's bound by its share of the result.
+ */
+struct TruncFloat {
+    mpz_class man;
+    long      exp = 0;
+    double    err = 0.0;   // relative error bound, in units of 2^-(w-1)
+};
+
+static void trunc_to(TruncFloat &x, unsigned long w) {
+    std::size_t bits = mpz_sizeinbase(x.man.get_mpz_t(), 2);
+    if (x.man != 0 && bits > w) {
+        unsigned long shift = bits - w;
+        mpz_tdiv_q_2exp(x.man.get_mpz_t(), x.man.get_mpz_t(), shift);
+        x.exp += static_cast<long>(shift);
+        x.err += 1.0;
+    }
+}
+
+/* log2 |x| (x non-zero) */
+static double trunc_log2(const TruncFloat &x) {
+    signed long e = 0;
+    double d = mpz_get_d_2exp(&e, x.man.get_mpz_t());
+    return std::log2(std::fabs(d)) + static_cast<double>(e + x.exp);
+}
+
+static void trunc_mul(TruncFloat &r, const TruncFloat &x, const TruncFloat &y,
+                      unsigned long w, unsigned threads) {
+    big_mul(r.man, x.man, y.man, threads);
+    r.exp = x.exp + y.exp;
+    r.err = x.err + y.err;
+    trunc_to(r, w);
+}
+
+static void trunc_add(TruncFloat &r, const TruncFloat &x, const TruncFloat &y,
+                      unsigned long w) {
+    // Align to the larger exponent; the other operand loses its low bits.
+    const TruncFloat &hi = x.exp >= y.exp ? x : y;
+    const TruncFloat &lo = x.exp >= y.exp ? y : x;
+    mpz_class shifted;
+    mpz_tdiv_q_2exp(shifted.get_mpz_t(), lo.man.get_mpz_t(),
+                    static_cast<unsigned long>(hi.exp - lo.exp));
+    bool lost = hi.exp != lo.exp && lo.man != 0;
+
+    big_add(r.man, hi.man, shifted);
+    r.exp = hi.exp;
+    if (r.man == 0) {
+        r.err = HUGE_VAL;
+        return;
+    }
+
+    double lr = trunc_log2(r);
+    double err = 0.0;
+    if (x.man != 0) err += x.err * std::exp2(trunc_log2(x) - lr);
+    if (y.man != 0) err += y.err * std::exp2(trunc_log2(y) - lr);
+    // alignment drops less than 2^hi.exp
+    if (lost) err += std::exp2(static_cast<double>(hi.exp) + (w - 1) - lr);
+    r.err = err;
+    trunc_to(r, w);
+}
+
+/* Estimated size in bits of P, Q, T for the range [a, b). */
+template <class Series>
+static double split_bits_estimate(unsigned long a, unsigned long b) {
+    mpz_class r, q;
+    q_term<Series>(b - 1, r, q);
+    return static_cast<double>(b - a) *
+           static_cast<double>(mpz_sizeinbase(q.get_mpz_t(), 2));
+}
+
+template <class Series>
+static void split_truncated(unsigned long a, unsigned long b, unsigned long w,
+                            TruncFloat &P, TruncFloat &Q, TruncFloat &T,
+                            const QScalePowers &powers, unsigned workers) {
+    if (split_bits_estimate<Series>(a, b) <= static_cast<double>(w)) {
+        // Exact below this point; round the result once.
+        mpz_class F;
+        split_node<Series>(a, b, P.man, F, T.man, &Q.man, powers, workers);
+        trunc_to(P, w);
+        trunc_to(Q, w);
+        trunc_to(T, w);
+        return;
+    }
+
+    unsigned long m = (a + b) / 2;
+    TruncFloat P1, Q1, T1, P2, Q2, T2;
+
+    split_fork(workers, b - a,
+        [&](unsigned n) { split_truncated<Series>(a, m, w, P1, Q1, T1, powers, n); },
+        [&](unsigned n) { split_truncated<Series>(m, b, w, P2, Q2, T2, powers, n); });
+    progress_task(TASK_MERGE, a, b);
+    PI_PROBE4(merge__start, a, b, mpz_size(T1.man.get_mpz_t()), mpz_size(T2.man.get_mpz_t()));
+
+    // T(a, b) = Q(m, b) * T(a, m) + P(a, m) * T(m, b)
+    TruncFloat x, y;
+    trunc_mul(x, Q2, T1, w, workers);
+    trunc_mul(y, P1, T2, w, workers);
+    trunc_add(T, x, y, w);
+
+    trunc_mul(P, P1, P2, w, workers);
+    trunc_mul(Q, Q1, Q2, w, workers);
+    PI_PROBE3(merge__done, a, b, mpz_size(T.man.get_mpz_t()));
+}
+
+/*
+ * GMP keeps the limb count of an mpz in an int. Past this size the exact
+ * P, Q, T near the root would outgrow it, so compute_scaled() merges the
+ * whole split truncated instead; a quarter of the limit leaves room for
+ * the merges of a node this size.
+ */
+static const std::uint64_t EXACT_SPLIT_MAX_BITS = (1ULL << 29) * GMP_NUMB_BITS;
+
+/* =========================
+   Chudnovsky series
+   ========================= */
+
+/*
+ * Chudnovsky terms for the generic engine. q(0) carries the constant
+ * factor like every other term, so the sum comes out divided by C^3/24:
+ *   π = (Q(0, N) * 426880 * sqrt(10005)) / (T(0, N) * C^3/24)
+ */
+struct Chudnovsky {
+    // ~14 digits per term
+    static unsigned long terms(unsigned long digits) {
+        return digits / 14 + 1;
+    }
+
+    // π = Q * 426880 * sqrt(10005) / (T * C^3/24)
+    static void finish(mpfr_t out, const mpz_class &, const mpz_class &Q,
+                       const mpz_class &T, unsigned threads) {
+        mpfr_prec_t prec = mpfr_get_prec(out);
+        mpfr_t sqrt10005, den;
+        mpfr_init2(sqrt10005, prec);
+        mpfr_init2(den,       prec);
+
+        const std::uint64_t n = prec_limbs(prec);
+
+        // sqrt(10005)
+        mpfr_set_ui(sqrt10005, 10005UL, MPFR_RNDN);
+        cost_sqrt(2 * n);
+        PI_PROBE1(sqrt__start, 2 * n);
+        mpfr_sqrt(sqrt10005, sqrt10005, MPFR_RNDN);
+        PI_PROBE1(sqrt__done, n);
+
+        // numerator = (Q * 426880) * sqrt(10005)
+        cost_mul(mpz_size(Q.get_mpz_t()), 1);
+        mpz_class Q_times_c = Q * 426880UL;
+        mpfr_set_z(out, Q_times_c.get_mpz_t(), MPFR_RNDN);
+        cost_mul(n, n);
+        parallel_mpfr_mul(out, out, sqrt10005, threads);
+
+        // denominator = T * C^3/24
+        cost_mul(mpz_size(T.get_mpz_t()), 1);
+        mpz_class T_times_c = T * q_scale;
+        mpfr_set_z(den, T_times_c.get_mpz_t(), MPFR_RNDN);
+
+        // pi = numerator / denominator
+        cost_div(2 * n, n);
+        PI_PROBE2(div__start, 2 * n, n);
+        mpfr_div(out, out, den, MPFR_RNDN);
+        PI_PROBE1(div__done, n);
+
+        mpfr_clear(sqrt10005);
+        mpfr_clear(den);
+    }
+
+    // P_k = (6k - 5)(2k - 1)(6k - 1), P_0 = 1
+    static void p(unsigned long k, mpz_class &out) {
+        if (k == 0) {
+            out = 1;
+            return;
+        }
+        out = 6UL * k - 5UL;
+        out *= 2UL * k - 1UL;
+        out *= 6UL * k - 1UL;
+    }
+
+    // Q_k = k^3 * C^3 / 24, where C = 640320 (r(0) = 1)
+    // C^3 / 24 = 10939058860032000
+    static void q_base(unsigned long k, mpz_class &out) { out = k == 0 ? 1UL : k; }
+    static const unsigned long q_power = 3;
+    static const unsigned long q_scale = 10939058860032000UL;
+
+    // a_k = (-1)^k * (13591409 + 545140134 k)
+    static void a(unsigned long k, mpz_class &out) {
+        out = 545140134UL;
+        out *= k;
+        out += 13591409UL;
+        if (k % 2 == 1) {
+            out = -out;
+        }
+    }
+};
+
+/* =========================
+   Other constants
+   ========================= */
+
+/* Terms needed when each term adds `digits_per_term` decimals.
+ * The slack covers the polynomial factor a(k) and the MPFR guard bits. */
+static unsigned long terms_for_rate(unsigned long digits, double digits_per_term) {
+    return static_cast<unsigned long>((digits + 30.0) / digits_per_term) + 2;
+}
+
+/* out = (num * T) / (den * Q), for series whose value is a scaled sum. */
+static void finish_quotient(mpfr_t out, const mpz_class &Q, const mpz_class &T,
+                            unsigned long num, unsigned long den) {
+    mpfr_t q;
+    mpfr_init2(q, mpfr_get_prec(out));
+
+    const std::uint64_t n = prec_limbs(mpfr_get_prec(out));
+    cost_mul(mpz_size(Q.get_mpz_t()), 1);
+    cost_mul(mpz_size(T.get_mpz_t()), 1);
+    mpz_class Q_times_c = Q * den;
+    mpz_class T_times_c = T * num;
+    mpfr_set_z(q,   Q_times_c.get_mpz_t(), MPFR_RNDN);
+    mpfr_set_z(out, T_times_c.get_mpz_t(), MPFR_RNDN);
+    cost_div(2 * n, n);
+    PI_PROBE2(div__start, 2 * n, n);
+    mpfr_div(out, out, q, MPFR_RNDN);
+    PI_PROBE1(div__done, n);
+
+    mpfr_clear(q);
+}
+
+/*
+ * e = sum_{k>=0} 1/k!
+ *   p(k) = 1, q(k) = k, a(k) = 1
+ */
+struct EulerE {
+    static unsigned long terms(unsigned long digits) {
+        // smallest N with log10(N!) > digits + 30
+        double log10_fact = 0.0;
+        unsigned long n = 1;
+        while (log10_fact <= digits + 30.0) {
+            ++n;
+            log10_fact += std::log10(static_cast<double>(n));
+        }
+        return n + 1;
+    }
+
+    static void p(unsigned long, mpz_class &out) { out = 1; }
+
+    static void q_base(unsigned long k, mpz_class &out) { out = k == 0 ? 1UL : k; }
+    static const unsigned long q_power = 1;
+    static const unsigned long q_scale = 1;
+
+    static void a(unsigned long, mpz_class &out) { out = 1; }
+
+    static void finish(mpfr_t out, const mpz_class &, const mpz_class &Q,
+                       const mpz_class &T, unsigned) {
+        finish_quotient(out, Q, T, 1, 1);
+    }
+};
+
+/*
+ * log(2) = 3/4 * sum_{k>=0} (-1)^k (k!)^2 / (2^k (2k+1)!)
+ *   p(k) = k, q(k) = 4(2k+1), a(k) = (-1)^k      (~3 bits per term)
+ * q(0) = 4 as well, so log(2) = 3 * T / Q.
+ */
+struct Log2 {
+    static unsigned long terms(unsigned long digits) {
+        return terms_for_rate(digits, 0.903089986991944); // log10(8)
+    }
+
+    static void p(unsigned long k, mpz_class &out) { out = k == 0 ? 1UL : k; }
+
+    static void q_base(unsigned long k, mpz_class &out) { out = 2UL * k + 1UL; }
+    static const unsigned long q_power = 1;
+    static const unsigned long q_scale = 4;
+
+    static void a(unsigned long k, mpz_class &out) { out = k % 2 ? -1 : 1; }
+
+    static void finish(mpfr_t out, const mpz_class &, const mpz_class &Q,
+                       const mpz_class &T, unsigned) {
+        finish_quotient(out, Q, T, 3, 1);
+    }
+};
+
+/*
+ * zeta(3), Amdeberhan-Zeilberger:
+ *   zeta(3) = 1/64 * sum_{k>=0} (-1)^k (k!)^10 (205k^2 + 250k + 77) / ((2k+1)!)^5
+ *   p(k) = k^5, q(k) = 32 (2k+1)^5, a(k) = (-1)^k (205k^2 + 250k + 77)
+ *   (~10 bits per term)
+ * q(0) = 32 as well, so zeta(3) = T / (2 Q).
+ */
+struct Zeta3 {
+    static unsigned long terms(unsigned long digits) {
+        return terms_for_rate(digits, 3.010299956639812); // log10(1024)
+    }
+
+    static void p(unsigned long k, mpz_class &out) {
+        if (k == 0) {
+            out = 1;
+            return;
+        }
+        out = k;
+        out *= k;
+        out *= k;
+        out *= k;
+        out *= k;
+    }
+
+    static void q_base(unsigned long k, mpz_class &out) { out = 2UL * k + 1UL; }
+    static const unsigned long q_power = 5;
+    static const unsigned long q_scale = 32;
+
+    static void a(unsigned long k, mpz_class &out) {
+        out = 205UL * k + 250UL;
+        out *= k;
+        out += 77UL;
+        if (k % 2 == 1) {
+            out = -out;
+        }
+    }
+
+    static void finish(mpfr_t out, const mpz_class &, const mpz_class &Q,
+                       const mpz_class &T, unsigned) {
+        finish_quotient(out, Q, T, 1, 2);
+    }
+};
+
+/*
+ * Catalan's constant, Pilehrood's series with the index shifted to start at 0:
+ *   G = 1/64 * sum_{k>=1} 256^k (580k^2 - 184k + 15)
+ *                 / (k^3 (2k-1) binom(6k,3k) binom(6k,4k) binom(4k,2k))
+ *   p(0) = 32, p(j) = 32 j^3 (2j-1)
+ *   q(j) = 9 ((6j+1)(6j+5))^2
+ *   a(j) = 580j^2 + 976j + 411                      (~7.5 bits per term)
+ */
+struct Catalan {
+    static unsigned long terms(unsigned long digits) {
+        return terms_for_rate(digits, 2.260666795250287); // log10(729/4)
+    }
+
+    static void p(unsigned long j, mpz_class &out) {
+        if (j == 0) {
+            out = 32;
+            return;
+        }
+        out = j;
+        out *= j;
+        out *= j;
+        out *= 2UL * j - 1UL;
+        out *= 32UL;
+    }
+
+    static void q_base(unsigned long j, mpz_class &out) {
+        out = 6UL * j + 1UL;
+        out *= 6UL * j + 5UL;
+    }
+    static const unsigned long q_power = 2;
+    static const unsigned long q_scale = 9;
+
+    static void a(unsigned long j, mpz_class &out) {
+        out = 580UL * j + 976UL;
+        out *= j;
+        out += 411UL;
+    }
+
+    static void finish(mpfr_t out, const mpz_class &, const mpz_class &Q,
+                       const mpz_class &T, unsigned) {
+        finish_quotient(out, Q, T, 1, 64);
+    }
+};
+
+/* =========================
+   Final stage
+   ========================= */
+
+/*
+ * The series constants carry a rigorous error bound through the final
+ * stage instead of a blanket 256 guard bits:
+ *
+ *   - finish() and scale_and_floor() round at most 7 times (RNDN, each
+ *     a relative 2^-prec), so together less than 2^(3 - prec),
+ *   - the series stops after n terms; from there on every series here
+ *     has terms that at least halve, so the tail is below twice the next
+ *     term, |a(n) p(n) P| / |q(n) T| relative to the sum,
+ *   - truncated merges add the bound they track.
+ *
+ * FINAL_GUARD_BITS covers the roundings and |value| < 4 with a margin
+ * that makes a floor inside the bound (pi * 10^d within ~2^-32 of an
+ * integer) rare. When it happens the floor is settled by recomputing the
+ * tail: more terms merged onto the sum when the series tail dominates,
+ * an exact split when truncation does, and twice the guard bits for the
+ * final stage, up to FINAL_GUARD_MAX_BITS.
+ */
+static const mpfr_prec_t FINAL_GUARD_BITS     = 40;
+static const mpfr_prec_t FINAL_GUARD_MAX_BITS = 40 << 8;
+
+/* Precision in bits: ceil(digits * log2(10)) + guard, in integers so it
+ * stays exact at any digit count */
+static mpfr_prec_t precision_for_digits(unsigned long digits, mpfr_prec_t guard = 256) {
+    const unsigned __int128 log2_10 = 3321928094887362348ULL;   // log2(10) * 10^18, rounded up
+    const unsigned __int128 scale   = 1000000000000000000ULL;
+    unsigned __int128 bits = (static_cast<unsigned __int128>(digits) * log2_10 + scale - 1) / scale;
+    return static_cast<mpfr_prec_t>(bits) + guard;
+}
+
+/* Largest digit count one run can hold. Truncated merges, the final
+ * stage and the conversion each keep a product of two prec-bit numbers
+ * in one mpz, below 2^31 limbs: about 20G digits. */
+static std::uint64_t max_digits_for_gmp() {
+    const std::uint64_t limbs = static_cast<std::uint64_t>(INT_MAX) - 16;
+    const std::uint64_t bits = limbs * GMP_NUMB_BITS / 2 - 64 - FINAL_GUARD_MAX_BITS;
+    const unsigned __int128 log2_10 = 3321928094887362348ULL;   // log2(10) * 10^18, rounded up
+    const unsigned __int128 scale   = 1000000000000000000ULL;
+    return static_cast<std::uint64_t>(static_cast<unsigned __int128>(bits) * scale / log2_10);
+}
+
+/* log2(2^a + 2^b + 2^c), without underflow for very negative terms */
+static double log2_sum(double a, double b, double c) {
+    double m = std::max(a, std::max(b, c));
+    if (m == -HUGE_VAL) return m;
+    return m + std::log2(std::exp2(a - m) + std::exp2(b - m) + std::exp2(c - m));
+}
+
+/* out = floor(value * 10^digits), with value scaled to `prec` bits.
+ * Returns the fractional part that was cut off; *edge_log2, when given,
+ * is a lower bound on log2 of the distance from value * 10^digits to the
+ * nearest integer, relative to value * 10^digits (-inf on an integer). */
+static double scale_and_floor(mpfr_t value, unsigned long digits, mpz_class &out,
+                              unsigned threads = 1, double *edge_log2 = nullptr) {
+    mpfr_prec_t prec = mpfr_get_prec(value);
+    mpfr_t scale, scaled, floored;
+    mpfr_init2(scale,   prec);
+    mpfr_init2(scaled,  prec);
+    mpfr_init2(floored, prec);
+
+    // scale = 10^digits
+    cost_pow(4, digits, prec_limbs(prec));
+    mpfr_ui_pow_ui(scale, 10UL, digits, MPFR_RNDN);
+
+    // scaled = value * 10^digits
+    cost_mul(prec_limbs(prec), prec_limbs(prec));
+    parallel_mpfr_mul(scaled, value, scale, threads);
+
+    // floor to truncate (no rounding)
+    mpfr_floor(floored, scaled);
+
+    // convert to integer
+    mpfr_get_z(out.get_mpz_t(), floored, MPFR_RNDN);
+
+    mpfr_exp_t top = mpfr_get_exp(scaled);
+    mpfr_sub(scaled, scaled, floored, MPFR_RNDN);
+    double frac = mpfr_get_d(scaled, MPFR_RNDN);
+
+    if (edge_log2) {
+        // 1 - frac is exact too: it needs no more bits than scaled had
+        if (mpfr_cmp_d(scaled, 0.5) > 0) mpfr_ui_sub(scaled, 1UL, scaled, MPFR_RNDN);
+        *edge_log2 = mpfr_zero_p(scaled) ? -HUGE_VAL
+                                         : static_cast<double>(mpfr_get_exp(scaled) - 1 - top);
+    }
+
+    mpfr_clear(scale);
+    mpfr_clear(scaled);
+    mpfr_clear(floored);
+    return frac;
+}
+
+/* log2 bound on the relative tail of the series after n terms (see
+ * above); P is scaled by 2^p_shift relative to T. */
+template <class Series>
+static double series_tail_log2(unsigned long n, mpz_srcptr P, mpz_srcptr T, long p_shift) {
+    mpz_class a, p, r, q;
+    Series::a(n, a);
+    Series::p(n, p);
+    q_term<Series>(n, r, q);
+    if (a == 0 || mpz_sgn(P) == 0) return -HUGE_VAL;
+    return 1.0 + static_cast<double>(mpz_sizeinbase(a.get_mpz_t(), 2)) +
+           static_cast<double>(mpz_sizeinbase(p.get_mpz_t(), 2)) +
+           static_cast<double>(mpz_sizeinbase(P, 2)) + static_cast<double>(p_shift) -
+           static_cast<double>(mpz_sizeinbase(q.get_mpz_t(), 2) - 1) -
+           static_cast<double>(mpz_sizeinbase(T, 2) - 1);
+}
+
+/* Sum Series by binary splitting and return floor(S * 10^digits). */
+template <class Series>
+static void compute_scaled(unsigned long digits, const Options &opts, mpz_class &out) {
+    unsigned long terms = Series::terms(digits);
+    mpfr_prec_t guard = FINAL_GUARD_BITS;
+    mpfr_prec_t prec = precision_for_digits(digits, guard);
+
+    mpz_class P, Q, T;
+    long p_shift = 0;                   // P is P * 2^p_shift against Q and T
+    double trunc_err_log2 = -HUGE_VAL;  // relative error of Q/T from truncation
+
+    // Only Q/T matters to finish(): bring both to a common exponent.
+    auto take_truncated = [&](const TruncFloat &tP, const TruncFloat &tQ, const TruncFloat &tT,
+                              unsigned long w) {
+        long base = std::min(tQ.exp, tT.exp);
+        mpz_mul_2exp(Q.get_mpz_t(), tQ.man.get_mpz_t(), tQ.exp - base);
+        mpz_mul_2exp(T.get_mpz_t(), tT.man.get_mpz_t(), tT.exp - base);
+        P = tP.man;
+        p_shift = tP.exp - base;
+        // relative error of Q/T: (err_Q + err_T) * 2^-(w-1)
+        trunc_err_log2 = std::log2(std::max(tQ.err + tT.err, 1.0)) - (w - 1.0);
+    };
+
+    // Past EXACT_SPLIT_MAX_BITS the exact sums would not fit an mpz.
+    const bool exact_fits =
+        split_bits_estimate<Series>(0, terms) <= static_cast<double>(EXACT_SPLIT_MAX_BITS);
+    auto sum_truncated = [&]() {
+        // Guard bits cover the accumulated error of ~4 truncations per level.
+        const unsigned long w = static_cast<unsigned long>(prec) + 64;
+        TruncFloat tP, tQ, tT;
+        QScalePowers powers;
+        progress_series(terms);
+        q_scale_powers<Series>(terms, powers, opts.threads);
+        split_truncated<Series>(0, terms, w, tP, tQ, tT, powers, opts.threads);
+        take_truncated(tP, tQ, tT, w);
+        std::cout << "Truncated merges: error bound 2^"
+                  << static_cast<long>(std::floor(trunc_err_log2 + 1.0))
+                  << " relative, target 2^-" << prec << "\n";
+    };
+
+    if (opts.truncate || !exact_fits) {
+        if (!exact_fits) {
+            std::cout << "Truncated merges: the exact sums would pass GMP's integer size limit\n";
+        }
+        sum_truncated();
+        if (exact_fits && trunc_err_log2 >= -static_cast<double>(prec)) {
+            std::cerr << "Truncated merges: error bound too large, recomputing exactly\n";
+            progress_series(terms);
+            binary_split<Series>(0, terms, P, Q, T, opts.threads);
+            p_shift = 0;
+            trunc_err_log2 = -HUGE_VAL;
+        }
+    } else {
+        progress_series(terms);
+        binary_split<Series>(0, terms, P, Q, T, opts.threads);
+    }
+
+    // Enough extra terms to push the tail below 2^(target - 2), at the
+    // rate the next term falls off (at least a bit per term).
+    auto extra_terms = [&](double tail_log2, double target_log2) {
+        mpz_class r, q, p;
+        q_term<Series>(terms, r, q);
+        Series::p(terms, p);
+        double rate = std::max(1.0, static_cast<double>(mpz_sizeinbase(q.get_mpz_t(), 2)) -
+                                    static_cast<double>(mpz_sizeinbase(p.get_mpz_t(), 2)) - 1.0);
+        return static_cast<unsigned long>((tail_log2 - (target_log2 - 2.0)) / rate) + 2;
+    };
+
+    progress_phase(PHASE_FINAL);
+    for (;;) {
+        mpfr_t value;
+        mpfr_init2(value, prec);
+        Series::finish(value, P, Q, T, opts.threads);
+        double edge_log2;
+        scale_and_floor(value, digits, out, opts.threads, &edge_log2);
+        mpfr_clear(value);
+
+        // relative error bound of value * 10^digits, doubled for the
+        // second-order terms and the inversion some finish() steps do
+        double round_log2 = 3.0 - static_cast<double>(prec);
+        double tail_log2 = series_tail_log2<Series>(terms, P.get_mpz_t(), T.get_mpz_t(), p_shift);
+        double err_log2 = 1.0 + log2_sum(round_log2, tail_log2, trunc_err_log2);
+        if (err_log2 < edge_log2) return;
+
+        if (guard >= FINAL_GUARD_MAX_BITS) {
+            std::cerr << "Final stage: the result is within 2^" << static_cast<long>(edge_log2)
+                      << " of a digit boundary even with " << guard
+                      << " guard bits; the last digit may be off by one\n";
+            return;
+        }
+        guard *= 2;
+        prec = precision_for_digits(digits, guard);
+        std::cerr << "Final stage: the floor is inside the error bound (2^"
+                  << static_cast<long>(std::ceil(err_log2)) << " relative), recomputing the tail with "
+                  << guard << " guard bits\n";
+
+        if (!exact_fits) {
+            // still too large to be exact: more terms if the tail needs
+            // them, and the truncated split again at the new precision
+            if (tail_log2 >= round_log2 - 1.0) {
+                terms += extra_terms(tail_log2, round_log2 - static_cast<double>(guard) / 2);
+            }
+            sum_truncated();
+            progress_phase(PHASE_FINAL);
+            continue;
+        }
+        if (opts.truncate && (p_shift != 0 || trunc_err_log2 > -HUGE_VAL)) {
+            // the tail merges below need the exact sums
+            progress_series(terms);
+            binary_split<Series>(0, terms, P, Q, T, opts.threads);
+            p_shift = 0;
+            trunc_err_log2 = -HUGE_VAL;
+            tail_log2 = series_tail_log2<Series>(terms, P.get_mpz_t(), T.get_mpz_t(), p_shift);
+        }
+        if (tail_log2 >= round_log2 - 1.0) {
+            unsigned long extra = extra_terms(tail_log2, round_log2 - static_cast<double>(guard) / 2);
+
+            // [0, terms) and [terms, terms + extra) merged like any node:
+            //   T = Q2 T + P T2,  Q = Q Q2,  P = P P2
+            mpz_class P2, Q2, T2;
+            progress_series(extra);
+            binary_split<Series>(terms, terms + extra, P2, Q2, T2, opts.threads);
+            big_mul(T, Q2, T, opts.threads);
+            big_mul(T2, P, T2, opts.threads);
+            big_add(T, T, T2);
+            big_mul(Q, Q, Q2, opts.threads);
+            big_mul(P, P, P2, opts.threads);
+            terms += extra;
+        }
+        progress_phase(PHASE_FINAL);
+    }
+}
+
+/* =========================
+   Small-precision pi (mpn)
+   ========================= */
+
+/*
+ * Below SMALL_PI_MAX_DIGITS the per-term mpz_class temporaries and the
+ * MPFR set-up are a visible share of the run time. This path computes
+ * the same Chudnovsky sum with mpn calls only, in limb buffers carved
+ * from one pooled arena that is sized once up front:
+ *
+ *   - leaves are evaluated in 128-bit integers,
+ *   - every node reserves its P, Q, T at the arena top before recursing
+ *     and releases its children's space after the merge,
+ *   - the final stage is integer-only:
+ *       floor(pi * 10^d) = floor(426880 * Q * S / T) >> g,
+ *       S = floor(sqrt(10005 * 10^(2d) * 4^g))
+ */
+
+static const unsigned long SMALL_PI_MAX_DIGITS = 200000;
+
+// Ranges this small are summed term by term (leaf batching).
+static const unsigned long SMALL_LEAF_TERMS = 16;
+
+// Guard bits carried through the integer square root.
+static const unsigned long SMALL_PI_GUARD_BITS = 64;
+
+/* Bump allocator over one limb buffer; released in LIFO order. */
+struct LimbArena {
+    std::vector<mp_limb_t> buf;
+    std::size_t top = 0;
+
+    mp_limb_t *alloc(std::size_t n) {
+        if (top + n > buf.size()) {
+            std::cerr << "internal error: limb arena exhausted\n";
+            std::abort();
+        }
+        mp_limb_t *p = buf.data() + top;
+        top += n;
+        return p;
+    }
+};
+
+/* Sign-magnitude view of a number living in the arena (n == 0 is zero). */
+struct LimbNum {
+    mp_limb_t *d   = nullptr;
+    mp_size_t  n   = 0;
+    bool       neg = false;
+};
+
+static mp_size_t limb_normalize(const mp_limb_t *d, mp_size_t n) {
+    while (n > 0 && d[n - 1] == 0) --n;
+    return n;
+}
+
+static void limb_set_u128(LimbNum &x, unsigned __int128 v, bool neg) {
+    x.d[0] = static_cast<mp_limb_t>(v);
+    x.d[1] = static_cast<mp_limb_t>(v >> 64);
+    x.n = limb_normalize(x.d, 2);
+    x.neg = neg;
+}
+
+/* r = x * y; r has room for x.n + y.n limbs and overlaps neither */
+static void limb_mul(LimbNum &r, const LimbNum &x, const LimbNum &y) {
+    if (x.n == 0 || y.n == 0) {
+        r.n = 0;
+        return;
+    }
+    PI_PROBE2(mul__start, x.n, y.n);
+    cost_mul(x.n, y.n);
+    trace_mul(x.n, y.n);
+    if (x.n >= y.n) mpn_mul(r.d, x.d, x.n, y.d, y.n);
+    else            mpn_mul(r.d, y.d, y.n, x.d, x.n);
+    r.n = limb_normalize(r.d, x.n + y.n);
+    r.neg = x.neg != y.neg;
+    PI_PROBE1(mul__done, r.n);
+}
+
+/* r = x + y (signed); r has room for max(x.n, y.n) + 1 limbs */
+static void limb_add(LimbNum &r, const LimbNum &x, const LimbNum &y) {
+    const LimbNum *big = &x, *small = &y;
+    if (x.n < y.n || (x.n == y.n && mpn_cmp(x.d, y.d, x.n) < 0)) {
+        big = &y;
+        small = &x;
+    }
+    if (small->n == 0) {
+        std::copy(big->d, big->d + big->n, r.d);
+        r.n = big->n;
+        r.neg = big->neg;
+        return;
+    }
+    cost_add(big->n);
+    if (x.neg == y.neg) {
+        mp_limb_t carry = mpn_add(r.d, big->d, big->n, small->d, small->n);
+        r.d[big->n] = carry;
+        r.n = big->n + (carry ? 1 : 0);
+    } else {
+        mpn_sub(r.d, big->d, big->n, small->d, small->n);
+        r.n = limb_normalize(r.d, big->n);
+    }
+    r.neg = r.n != 0 && big->neg;
+}
+
+/* x *= v in place; x has room for one more limb */
+static void limb_mul_1(LimbNum &x, mp_limb_t v) {
+    cost_mul(x.n, 1);
+    mp_limb_t carry = mpn_mul_1(x.d, x.d, x.n, v);
+    if (carry) x.d[x.n++] = carry;
+}
+
+/* acc += x (signed); acc has room for one more limb, x may be clobbered */
+static void limb_add_to(LimbNum &acc, LimbNum &x) {
+    if (x.n == 0) return;
+    if (acc.n < x.n) {
+        // add into x, the longer operand, then move the result back
+        std::swap(acc, x);
+        limb_add_to(acc, x);
+        std::copy(acc.d, acc.d + acc.n, x.d);
+        x.n = acc.n;
+        x.neg = acc.neg;
+        std::swap(acc, x);
+        return;
+    }
+    cost_add(acc.n);
+    if (acc.neg == x.neg) {
+        mp_limb_t carry = mpn_add(acc.d, acc.d, acc.n, x.d, x.n);
+        if (carry) acc.d[acc.n++] = carry;
+    } else if (acc.n > x.n || mpn_cmp(acc.d, x.d, acc.n) >= 0) {
+        mpn_sub(acc.d, acc.d, acc.n, x.d, x.n);
+        acc.n = limb_normalize(acc.d, acc.n);
+    } else {
+        mpn_sub_n(acc.d, x.d, acc.d, acc.n);
+        acc.n = limb_normalize(acc.d, acc.n);
+        acc.neg = x.neg;
+    }
+    if (acc.n == 0) acc.neg = false;
+}
+
+/* Terms a+1 .. b-1 appended one at a time with single-limb multiplies:
+ *   P' = P p(k),  T' = T k^3 (C^3/24) + a(k) P',  Q' = Q k^3 (C^3/24)
+ * (p(k), k^3 and |a(k)| fit a limb for every k this path sees). */
+static void small_leaf(unsigned long a, unsigned long b, LimbArena &arena,
+                       LimbNum &P, LimbNum &Q, LimbNum &T) {
+    LimbNum t;
+    t.d = arena.alloc(b - a + 2);
+
+    for (unsigned long k = a + 1; k < b; ++k) {
+        mp_limb_t k3 = static_cast<mp_limb_t>(k) * k * k;
+        mp_limb_t p  = static_cast<mp_limb_t>(6 * k - 5) * (2 * k - 1) * (6 * k - 1);
+
+        limb_mul_1(P, p);
+
+        cost_mul(P.n, 1);
+        mp_limb_t carry = mpn_mul_1(t.d, P.d, P.n, 13591409UL + 545140134UL * k);
+        t.n = P.n;
+        if (carry) t.d[t.n++] = carry;
+        t.neg = k % 2 == 1;
+
+        limb_mul_1(T, k3);
+        limb_mul_1(T, 10939058860032000UL);
+        limb_add_to(T, t);
+
+        limb_mul_1(Q, k3);
+        limb_mul_1(Q, 10939058860032000UL);
+    }
+}
+
+static void small_split(unsigned long a, unsigned long b, LimbArena &arena,
+                        LimbNum &P, LimbNum &Q, LimbNum &T) {
+    const std::size_t n = b - a;
+
+    // Per term: p(k) < 2^64, q(k) < 2^128, |a(k) p(k)| < 2^128.
+    P.d = arena.alloc(n);
+    Q.d = arena.alloc(2 * n);
+    T.d = arena.alloc(2 * n + 2);
+    std::size_t mark = arena.top;
+
+    if (n <= SMALL_LEAF_TERMS) {
+        unsigned __int128 k = a;
+        if (a == 0) {
+            limb_set_u128(P, 1, false);
+            limb_set_u128(Q, 1, false);
+            limb_set_u128(T, 13591409, false);
+        } else {
+            unsigned __int128 p = (6 * k - 5) * (2 * k - 1) * (6 * k - 1);
+            unsigned __int128 q = k * k * k * 10939058860032000ULL;
+            unsigned __int128 t = (13591409 + 545140134 * k) * p;
+            limb_set_u128(P, p, false);
+            limb_set_u128(Q, q, false);
+            limb_set_u128(T, t, a % 2 == 1);
+        }
+        small_leaf(a, b, arena, P, Q, T);
+        arena.top = mark;
+        return;
+    }
+
+    unsigned long m = (a + b) / 2;
+    LimbNum P1, Q1, T1, P2, Q2, T2;
+    small_split(a, m, arena, P1, Q1, T1);
+    small_split(m, b, arena, P2, Q2, T2);
+    PI_PROBE4(merge__start, a, b, T1.n, T2.n);
+
+    // T(a, b) = Q(m, b) * T(a, m) + P(a, m) * T(m, b)
+    LimbNum x, y;
+    x.d = arena.alloc(Q2.n + T1.n);
+    y.d = arena.alloc(P1.n + T2.n);
+    limb_mul(x, Q2, T1);
+    limb_mul(y, P1, T2);
+    limb_add(T, x, y);
+
+    // P(a, b) = P(a, m) * P(m, b),  Q(a, b) = Q(a, m) * Q(m, b)
+    limb_mul(P, P1, P2);
+    limb_mul(Q, Q1, Q2);
+    PI_PROBE3(merge__done, a, b, T.n);
+
+    arena.top = mark;
+}
+
+/* r = base^e; r and scratch t each have room for the result + 1 limbs */
+static mp_size_t limb_pow_ui(mp_limb_t *r, mp_limb_t *t, mp_limb_t base, unsigned long e) {
+    r[0] = 1;
+    mp_size_t n = 1;
+    for (int bit = 63; bit >= 0; --bit) {
+        if (n > 1 || r[0] != 1) {
+            cost_mul(n, n);
+            mpn_sqr(t, r, n);
+            n = limb_normalize(t, 2 * n);
+            std::copy(t, t + n, r);
+        }
+        if ((e >> bit) & 1UL) {
+            cost_mul(n, 1);
+            mp_limb_t carry = mpn_mul_1(r, r, n, base);
+            if (carry) r[n++] = carry;
+        }
+    }
+    return n;
+}
+
+/* out = floor(pi * 10^digits) using mpn calls only; false when the
+ * floor is too close to call with SMALL_PI_GUARD_BITS. */
+static bool compute_pi_small(unsigned long digits, mpz_class &out) {
+    const unsigned long terms = Chudnovsky::terms(digits);
+    const unsigned long g     = SMALL_PI_GUARD_BITS;
+
+    // radicand = 10005 * 5^(2d) * 2^(2d + 2g); limbs for 5^(2d) < 2^(4.65 d)
+    const std::size_t pow_limbs   = (2 * digits * 2322UL / 1000UL) / 64 + 4;
+    const std::size_t shift_limbs = (2 * digits + 2 * g) / 64 + 2;
+    const std::size_t rad_limbs   = pow_limbs + shift_limbs + 2;
+
+    static thread_local LimbArena arena;
+    std::size_t need = 20 * terms + 64 * 40 + 8 * rad_limbs;
+    if (arena.buf.size() < need) arena.buf.resize(need);
+    arena.top = 0;
+
+    LimbNum P, Q, T;
+    small_split(0, terms, arena, P, Q, T);
+    progress_phase(PHASE_FINAL);
+
+    // relative tail of the series (see the final stage)
+    mpz_t Pv, Tv;
+    mpz_roinit_n(Pv, P.d, P.n);
+    mpz_roinit_n(Tv, T.d, T.n);
+    const double tail_log2 = series_tail_log2<Chudnovsky>(terms, Pv, Tv, 0);
+
+    // 10005 * 5^(2d), then shift into place for 2^(2d + 2g)
+    mp_limb_t *rad     = arena.alloc(rad_limbs);
+    mp_limb_t *scratch = arena.alloc(2 * pow_limbs + 2);
+    std::fill(rad, rad + rad_limbs, 0);
+    mp_size_t pn = limb_pow_ui(scratch + pow_limbs + 1, scratch, 5, 2 * digits);
+    const mp_limb_t *pw = scratch + pow_limbs + 1;
+
+    const unsigned long shift = 2 * digits + 2 * g;
+    const std::size_t   lshift = shift / 64;
+    const unsigned      bshift = static_cast<unsigned>(shift % 64);
+    mp_limb_t carry = mpn_mul_1(rad + lshift, pw, pn, 10005UL);
+    rad[lshift + pn] = carry;
+    mp_size_t wn = pn + 1;
+    if (bshift) {
+        rad[lshift + wn] = mpn_lshift(rad + lshift, rad + lshift, wn, bshift);
+        ++wn;
+    }
+    mp_size_t rn = limb_normalize(rad, lshift + wn);
+
+    // S = floor(sqrt(radicand)) = floor(sqrt(10005) * 10^d * 2^g)
+    LimbNum S;
+    S.d = arena.alloc(rn / 2 + 1);
+    cost_sqrt(rn);
+    PI_PROBE1(sqrt__start, rn);
+    mpn_sqrtrem(S.d, nullptr, rad, rn);
+    S.n = limb_normalize(S.d, (rn + 1) / 2);
+    PI_PROBE1(sqrt__done, S.n);
+
+    // Q and T carry far more bits than the quotient needs; keep the top
+    // d*log2(10) + 2g bits of both (same shift, so Q/T is unchanged up to
+    // a relative 2^-(kept bits), well inside the guard bits).
+    const mp_size_t keep = static_cast<mp_size_t>((digits * 3322UL / 1000UL + 2 * g) / 64 + 2);
+    if (T.n > keep) {
+        mp_size_t drop = T.n - keep;
+        if (drop > Q.n - 1) drop = Q.n - 1;
+        Q.d += drop;
+        Q.n -= drop;
+        T.d += drop;
+        T.n -= drop;
+    }
+
+    // num = 426880 * Q * S
+    LimbNum num;
+    num.d = arena.alloc(Q.n + S.n + 1);
+    limb_mul(num, Q, S);
+    cost_mul(num.n, 1);
+    carry = mpn_mul_1(num.d, num.d, num.n, 426880UL);
+    if (carry) num.d[num.n++] = carry;
+
+    // quotient = floor(num / T), then drop the guard bits
+    mp_limb_t *quot = arena.alloc(num.n - T.n + 1);
+    mp_limb_t *rem  = arena.alloc(T.n);
+    cost_div(num.n, T.n);
+    PI_PROBE2(div__start, num.n, T.n);
+    mpn_tdiv_qr(quot, rem, 0, num.d, num.n, T.d, T.n);
+    mp_size_t qn = limb_normalize(quot, num.n - T.n + 1);
+    PI_PROBE1(div__done, qn);
+
+    mpz_t view;
+    mpz_roinit_n(view, quot, qn);
+    out = mpz_class(view);
+    out >>= g;
+
+    // Error of quot in its own units: the series tail (doubled for the
+    // division by T), the floors of S and the division and the dropped
+    // limbs of Q and T (each under 2^-(d log2(10) + g) relative), and 1
+    // for the final floor. The dropped g bits must clear it both ways.
+    const double digit_bits = static_cast<double>(digits) * 3.321928094887362;
+    const double err_log2 = static_cast<double>(mpz_sizeinbase(view, 2)) +
+                            log2_sum(1.0 + tail_log2, 2.0 - digit_bits - static_cast<double>(g), -HUGE_VAL);
+    const double err = std::exp2(std::min(err_log2, 1024.0)) + 1.0;
+    const double low = static_cast<double>(quot[0] & ((mp_limb_t(1) << (g - 1) << 1) - 1));
+    const double unit = std::ldexp(1.0, static_cast<int>(g));
+    return low > err && unit - low > err;
+}
+
+/* The mpn path is serial and never truncates, so an explicit -t above 1
+ * or --truncate sends even small runs to the generic engine. */
+static bool pi_small_path(unsigned long digits, const Options &opts) {
+    return digits <= SMALL_PI_MAX_DIGITS && !opts.truncate &&
+           (opts.threads <= 1 || opts.auto_threads);
+}
+
+/* pi dispatch: mpn path for small precisions, generic engine above. */
+static void compute_pi(unsigned long digits, const Options &opts, mpz_class &out) {
+    if (pi_small_path(digits, opts)) {
+        progress_series(0);
+        if (compute_pi_small(digits, out)) return;
+    }
+    compute_scaled<Chudnovsky>(digits, opts, out);
+}
+
+/* =========================
+   Algebraic constants (Newton)
+   ========================= */
+
+/*
+ * r = n^(-1/k) by Newton iteration with precision doubling:
+ *
+ *   r <- r + r * (1 - n * r^k) / k
+ *
+ * Each step doubles the number of correct bits, so the steps run at
+ * precisions target, target/2, target/4, ... and only the last one
+ * costs a full-precision multiply. The products run on parallel_mpfr_mul
+ * with `threads` threads.
+ */
+static void newton_inv_root(mpfr_t r, unsigned long n, unsigned long k, unsigned threads) {
+    const mpfr_prec_t target = mpfr_get_prec(r);
+    const mpfr_prec_t guard  = 32;
+
+    std::vector<mpfr_prec_t> steps;
+    for (mpfr_prec_t p = target; p > 2 * guard; p = p / 2 + guard) {
+        steps.push_back(p);
+    }
+
+    // ~50 correct bits from double precision
+    mpfr_set_prec(r, 2 * guard);
+    mpfr_set_d(r, std::pow(static_cast<double>(n), -1.0 / static_cast<double>(k)),
+               MPFR_RNDN);
+
+    mpfr_t t;
+    mpfr_init2(t, target);
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
+        mpfr_prec_t p = *it;
+        mpfr_prec_round(r, p, MPFR_RNDN);
+        mpfr_set_prec(t, p);
+
+        // t = 1 - n * r^k; about half its leading bits cancel
+        parallel_mpfr_pow_ui(t, r, k, threads);
+        mpfr_mul_ui(t, t, n, MPFR_RNDN);
+        mpfr_ui_sub(t, 1UL, t, MPFR_RNDN);
+
+        // r += r * t / k, needed only to half precision
+        mpfr_prec_round(t, p / 2 + guard, MPFR_RNDN);
+        parallel_mpfr_mul(t, t, r, threads);
+        mpfr_div_ui(t, t, k, MPFR_RNDN);
+        mpfr_add(r, r, t, MPFR_RNDN);
+    }
+    mpfr_prec_round(r, target, MPFR_RNDN);
+    mpfr_clear(t);
+}
+
+/* out = floor(n^(1/k) * 10^digits) */
+static void compute_root(unsigned long n, unsigned long k, unsigned long digits,
+                         unsigned threads, mpz_class &out) {
+    if (n == 0) {
+        out = 0;
+        return;
+    }
+
+    mpfr_t r;
+    mpfr_init2(r, precision_for_digits(digits));
+
+    // n^(1/k) = n * (n^(-1/k))^(k-1)
+    progress_phase(PHASE_NEWTON);
+    newton_inv_root(r, n, k, threads);
+    parallel_mpfr_pow_ui(r, r, k - 1, threads);
+    mpfr_mul_ui(r, r, n, MPFR_RNDN);
+
+    double frac = scale_and_floor(r, digits, out, threads);
+    mpfr_clear(r);
+
+    // Perfect powers give exact results that may land a hair below the
+    // integer; settle that case exactly: (out + 1)^k <= n * 10^(digits k).
+    if (frac > 1.0 - 1e-9) {
+        mpz_class up = out + 1, up_pow, bound;
+        mpz_pow_ui(up_pow.get_mpz_t(), up.get_mpz_t(), k);
+        mpz_ui_pow_ui(bound.get_mpz_t(), 10UL, digits * k);
+        bound *= n;
+        if (up_pow <= bound) out = up;
+    }
+}
+
+/* Golden ratio: phi = (1 + sqrt(5)) / 2 = (1 + 5 / sqrt(5)) / 2 */
+static void compute_golden(unsigned long digits, const Options &opts, mpz_class &out) {
+    mpfr_t r;
+    mpfr_init2(r, precision_for_digits(digits));
+
+    progress_phase(PHASE_NEWTON);
+    newton_inv_root(r, 5UL, 2UL, opts.threads);
+    mpfr_mul_ui(r, r, 5UL, MPFR_RNDN);
+    mpfr_add_ui(r, r, 1UL, MPFR_RNDN);
+    mpfr_div_2ui(r, r, 1UL, MPFR_RNDN);
+
+    scale_and_floor(r, digits, out, opts.threads);
+    mpfr_clear(r);
+}
+
+/* Constants selectable with --constant. */
+struct ConstantDef {
+    const char *name;    // command-line name
+    const char *label;   // printed name
+    const char *method;
+    void (*compute)(unsigned long digits, const Options &opts, mpz_class &out);
+};
+
+static const ConstantDef CONSTANTS[] = {
+    { "pi",      "pi",      "Chudnovsky",            compute_pi                 },
+    { "e",       "e",       "Taylor series",         compute_scaled<EulerE>     },
+    { "log2",    "log(2)",  "hypergeometric series", compute_scaled<Log2>       },
+    { "zeta3",   "zeta(3)", "Amdeberhan-Zeilberger", compute_scaled<Zeta3>      },
+    { "catalan", "Catalan", "Pilehrood series",      compute_scaled<Catalan>    },
+    { "phi",     "phi",     "Newton",                compute_golden             },
+};
+
+static const ConstantDef *find_constant(const std::string &name) {
+    for (const ConstantDef &c : CONSTANTS) {
+        if (name == c.name) return &c;
+    }
+    return nullptr;
+}
+
+/* =========================
+   Output
+   ========================= */
+
+/*
+ * Digits are written in chunks, and each chunk of the fraction is also
+ * handed to the consumers (--stats and friends) while it is still in
+ * cache, so analysis never re-reads the output.
+ */
+static const std::size_t OUTPUT_CHUNK_DIGITS = 1 << 20;
+
+struct DigitSink {
+    virtual ~DigitSink() = default;
+    virtual void feed(const char *digits, std::size_t n) = 0;
+    virtual void finish() = 0;
+};
+
+static void write_chunked(const char *digits, std::size_t n,
+                          const std::vector<DigitSink *> &sinks, bool echo) {
+    progress.to_write.store(n, std::memory_order_relaxed);
+    progress.written.store(0, std::memory_order_relaxed);
+    progress_phase(PHASE_OUTPUT);
+    for (std::size_t off = 0; off < n; off += OUTPUT_CHUNK_DIGITS) {
+        std::size_t len = std::min(OUTPUT_CHUNK_DIGITS, n - off);
+        PI_PROBE2(write__start, off, len);
+        if (echo) std::cout.write(digits + off, len);
+        for (DigitSink *sink : sinks) sink->feed(digits + off, len);
+        progress.written.fetch_add(len, std::memory_order_relaxed);
+        PI_PROBE2(write__done, off, len);
+    }
+}
+
+/* Print floor(x * 10^digits) as <int>.<digits>; echo = false only feeds the sinks */
+static void print_fixed(const mpz_class &scaled, unsigned long digits,
+                        const std::vector<DigitSink *> &sinks, bool echo) {
+    // Convert to base-10 string
+    progress_phase(PHASE_CONVERT);
+    std::string str = scaled.get_str(10);
+    std::size_t len = str.size();
+    std::size_t needed = static_cast<std::size_t>(digits) + 1; // at least one integer digit
+
+    if (len < needed) {
+        // left-pad with zeros
+        std::string padded(needed - len, '0');
+        padded += str;
+        str.swap(padded);
+        len = needed;
+    }
+
+    std::size_t int_len = len - digits;
+    if (echo) {
+        std::cout.write(str.data(), int_len);
+        std::cout << '.';
+    }
+    write_chunked(str.data() + int_len, digits, sinks, echo);
+    if (echo) std::cout << '\n';
+    for (DigitSink *sink : sinks) sink->finish();
+}
+
+/*
+ * Print the last `len` digits of scaled (the --range window). Only the
+ * window goes through radix conversion; the digits before it are
+ * dropped by a single remainder.
+ */
+static void print_range(const mpz_class &scaled, unsigned long len,
+                        const std::vector<DigitSink *> &sinks, bool echo) {
+    progress_phase(PHASE_CONVERT);
+    mpz_class pow10, window;
+    mpz_ui_pow_ui(pow10.get_mpz_t(), 10, len);
+    mpz_tdiv_r(window.get_mpz_t(), scaled.get_mpz_t(), pow10.get_mpz_t());
+
+    std::string str = window.get_str(10);
+    if (str.size() < len) str.insert(0, len - str.size(), '0');
+    write_chunked(str.data(), str.size(), sinks, echo);
+    if (echo) std::cout << '\n';
+    for (DigitSink *sink : sinks) sink->finish();
+}
+
+/* =========================
+   CPU dispatch
+   ========================= */
+
+/*
+ * The SIMD kernels (digit histogram and pattern counts for --stats, byte compare for
+ * --compare, BCD packing and unpacking for --pack-digits and packed
+ * compares) are compiled in generic, AVX2 and AVX-512 variants with
+ * target attributes, so one binary built without -march runs the best
+ * variant its host supports. The level is read once at startup from
+ * cpuid (__builtin_cpu_supports); --isa lowers it, e.g. to compare the
+ * variants on one machine. Kernels switch on it once per call, and
+ * calls cover whole blocks of digits.
+ */
+
+enum CpuLevel { CPU_GENERIC, CPU_AVX2, CPU_AVX512 };
+
+static const char *const CPU_LEVEL_NAMES[] = { "generic", "avx2", "avx512" };
+
+#ifdef PI_X86
+#define PI_TARGET_AVX2   __attribute__((target("avx2")))
+#define PI_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#endif
+
+static CpuLevel cpu_level = CPU_GENERIC;
+
+static CpuLevel detect_cpu_level() {
+#ifdef PI_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return CPU_AVX512;
+    if (__builtin_cpu_supports("avx2")) return CPU_AVX2;
+#endif
+    return CPU_GENERIC;
+}
+
+/* Pick the best supported level, at most the one named by --isa (empty = no cap). */
+static bool select_cpu_level(const std::string &cap_name) {
+    CpuLevel cap = CPU_AVX512;
+    if (!cap_name.empty()) {
+        auto it = std::find(std::begin(CPU_LEVEL_NAMES), std::end(CPU_LEVEL_NAMES), cap_name);
+        if (it == std::end(CPU_LEVEL_NAMES)) {
+            std::cerr << "Unknown --isa \"" << cap_name << "\", expected generic, avx2 or avx512\n";
+            return false;
+        }
+        cap = static_cast<CpuLevel>(it - std::begin(CPU_LEVEL_NAMES));
+    }
+    cpu_level = std::min(detect_cpu_level(), cap);
+    return true;
+}
+
+/* =========================
+   Digit statistics
+   ========================= */
+
+/*
+ * --stats: classical randomness tests on the fractional digits, run as
+ * a consumer of the output pipeline. Each block of --stats-block digits
+ * gets its own line and the totals are reported at the end:
+ *
+ *   freq   counts of 0..9                              (9 dof)
+ *   pairs  non-overlapping digit pairs                 (99 dof)
+ *   poker  5-digit hands by number of distinct digits  (4 dof)
+ *   gap    distance between repeats of the same digit  (STATS_GAP_CELLS - 1 dof)
+ *
+ * Pairs, hands and gaps that straddle a block boundary are counted in
+ * the block where they end.
+ *
+ * The AVX2 and AVX-512 kernels count pairs, hands and gaps over steps of
+ * 30 or 60 digits (whole pairs and hands) with compare masks: the gap
+ * of each digit is the first k in 1..31 for which the digit k places
+ * back is equal, and the first four of those masks tell which digits
+ * repeat inside their hand. Only the pair codes are counted one by one.
+ */
+
+static const unsigned STATS_GAP_CELLS = 32; // gaps 0..30, then >= 31
+
+struct DigitCounts {
+    std::uint64_t digits = 0;
+    std::uint64_t freq[10] = {};
+    std::uint64_t pairs[100] = {};
+    std::uint64_t poker[5] = {};
+    std::uint64_t gaps[STATS_GAP_CELLS] = {};
+
+    void add(const DigitCounts &o) {
+        digits += o.digits;
+        for (unsigned i = 0; i < 10; ++i) freq[i] += o.freq[i];
+        for (unsigned i = 0; i < 100; ++i) pairs[i] += o.pairs[i];
+        for (unsigned i = 0; i < 5; ++i) poker[i] += o.poker[i];
+        for (unsigned i = 0; i < STATS_GAP_CELLS; ++i) gaps[i] += o.gaps[i];
+    }
+};
+
+#ifdef PI_X86
+/* Counts whole vectors of d[0..n); returns the digits counted. */
+PI_TARGET_AVX2
+static std::size_t histogram_avx2(const char *d, std::size_t n, std::uint64_t count[10]) {
+    std::size_t i = 0;
+    // 8-bit counters per digit, drained every 255 vectors before they wrap
+    const __m256i zero = _mm256_setzero_si256();
+    while (n - i >= 32) {
+        std::size_t vectors = std::min<std::size_t>((n - i) / 32, 255);
+        __m256i acc[10];
+        for (unsigned v = 0; v < 10; ++v) acc[v] = zero;
+        for (std::size_t j = 0; j < vectors; ++j, i += 32) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d + i));
+            for (unsigned v = 0; v < 10; ++v) {
+                __m256i eq = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>('0' + v)));
+                acc[v] = _mm256_sub_epi8(acc[v], eq);
+            }
+        }
+        for (unsigned v = 0; v < 10; ++v) {
+            __m256i s = _mm256_sad_epu8(acc[v], zero);
+            count[v] += static_cast<std::uint64_t>(_mm256_extract_epi64(s, 0)) +
+                        static_cast<std::uint64_t>(_mm256_extract_epi64(s, 1)) +
+                        static_cast<std::uint64_t>(_mm256_extract_epi64(s, 2)) +
+                        static_cast<std::uint64_t>(_mm256_extract_epi64(s, 3));
+        }
+    }
+    return i;
+}
+
+PI_TARGET_AVX512
+static std::size_t histogram_avx512(const char *d, std::size_t n, std::uint64_t count[10]) {
+    std::size_t i = 0;
+    for (; n - i >= 64; i += 64) {
+        __m512i x = _mm512_loadu_si512(d + i);
+        for (unsigned v = 0; v < 10; ++v) {
+            __mmask64 eq = _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8(static_cast<char>('0' + v)));
+            count[v] += static_cast<std::uint64_t>(__builtin_popcountll(eq));
+        }
+    }
+    return i;
+}
+
+/* Hand offsets p % 5 >= k for the first `len` positions of a step. */
+static std::uint64_t hand_offset_mask(unsigned k, unsigned len) {
+    std::uint64_t m = 0;
+    for (unsigned p = 0; p < len; ++p) {
+        if (p % 5 >= k) m |= 1ULL << p;
+    }
+    return m;
+}
+
+/*
+ * Pair, poker and gap counts of d[i..) in steps of 30 digits, while a
+ * whole vector fits; returns where it stopped. Needs the 31 digits
+ * before d[i], every digit value seen before, and d[i] at a position
+ * that is a multiple of 10 (pair and hand boundaries).
+ */
+PI_TARGET_AVX2
+static std::size_t pattern_counts_avx2(const char *d, std::size_t i, std::size_t n, DigitCounts &c) {
+    const unsigned step = 30;
+    const std::uint32_t live = (1u << step) - 1;
+    std::uint32_t same_hand[5];
+    for (unsigned k = 1; k < 5; ++k) same_hand[k] = static_cast<std::uint32_t>(hand_offset_mask(k, step));
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i weights = _mm256_set1_epi16(0x010A);  // 10 * first + second
+    alignas(32) std::uint16_t codes[16];
+    std::uint64_t gaps[STATS_GAP_CELLS] = {}, pairs[100] = {};
+
+    for (; n - i >= 32; i += step) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d + i));
+        std::uint32_t found = ~live, repeat = 0;  // lanes past the step count as found
+        for (unsigned k = 1; k < STATS_GAP_CELLS; ++k) {
+            __m256i back = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d + i - k));
+            std::uint32_t eq = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, back)));
+            if (k < 5) repeat |= eq & same_hand[k];
+            gaps[k - 1] += static_cast<unsigned>(__builtin_popcount(eq & ~found));
+            found |= eq;
+        }
+        gaps[STATS_GAP_CELLS - 1] += static_cast<unsigned>(__builtin_popcount(~found));
+
+        std::uint32_t fresh = ~repeat & live;
+        for (unsigned h = 0; h < step; h += 5) ++c.poker[__builtin_popcount((fresh >> h) & 31) - 1];
+
+        _mm256_store_si256(reinterpret_cast<__m256i *>(codes),
+                           _mm256_maddubs_epi16(_mm256_sub_epi8(x, zero), weights));
+        for (unsigned j = 0; j < step / 2; ++j) ++pairs[codes[j]];
+    }
+    for (unsigned g = 0; g < STATS_GAP_CELLS; ++g) c.gaps[g] += gaps[g];
+    for (unsigned p = 0; p < 100; ++p) c.pairs[p] += pairs[p];
+    return i;
+}
+
+/* As pattern_counts_avx2, in steps of 60 digits. */
+PI_TARGET_AVX512
+static std::size_t pattern_counts_avx512(const char *d, std::size_t i, std::size_t n, DigitCounts &c) {
+    const unsigned step = 60;
+    const std::uint64_t live = (1ULL << step) - 1;
+    std::uint64_t same_hand[5];
+    for (unsigned k = 1; k < 5; ++k) same_hand[k] = hand_offset_mask(k, step);
+    const __m512i zero = _mm512_set1_epi8('0');
+    const __m512i weights = _mm512_set1_epi16(0x010A);  // 10 * first + second
+    alignas(64) std::uint16_t codes[32];
+    std::uint64_t gaps[STATS_GAP_CELLS] = {}, pairs[100] = {};
+
+    for (; n - i >= 64; i += step) {
+        __m512i x = _mm512_loadu_si512(d + i);
+        std::uint64_t found = ~live, repeat = 0;  // lanes past the step count as found
+        for (unsigned k = 1; k < STATS_GAP_CELLS; ++k) {
+            std::uint64_t eq = _mm512_cmpeq_epi8_mask(x, _mm512_loadu_si512(d + i - k));
+            if (k < 5) repeat |= eq & same_hand[k];
+            gaps[k - 1] += static_cast<std::uint64_t>(__builtin_popcountll(eq & ~found));
+            found |= eq;
+        }
+        gaps[STATS_GAP_CELLS - 1] += static_cast<std::uint64_t>(__builtin_popcountll(~found));
+
+        std::uint64_t fresh = ~repeat & live;
+        for (unsigned h = 0; h < step; h += 5) ++c.poker[__builtin_popcountll((fresh >> h) & 31) - 1];
+
+        _mm512_store_si512(codes, _mm512_maddubs_epi16(_mm512_sub_epi8(x, zero), weights));
+        for (unsigned j = 0; j < step / 2; ++j) ++pairs[codes[j]];
+    }
+    for (unsigned g = 0; g < STATS_GAP_CELLS; ++g) c.gaps[g] += gaps[g];
+    for (unsigned p = 0; p < 100; ++p) c.pairs[p] += pairs[p];
+    return i;
+}
+#endif
+
+/* Pattern counts of d[i..) by the best kernel; returns where it stopped
+ * (i itself on the generic level). Preconditions as pattern_counts_avx2. */
+static std::size_t pattern_counts(const char *d, std::size_t i, std::size_t n, DigitCounts &c) {
+#ifdef PI_X86
+    if (cpu_level == CPU_AVX512) return pattern_counts_avx512(d, i, n, c);
+    if (cpu_level == CPU_AVX2) return pattern_counts_avx2(d, i, n, c);
+#endif
+    (void)d;
+    (void)n;
+    (void)c;
+    return i;
+}
+
+/* Add the counts of ASCII digits d[0..n) to count[0..9]. */
+static void histogram_digits(const char *d, std::size_t n, std::uint64_t count[10]) {
+    std::size_t i = 0;
+#ifdef PI_X86
+    if (cpu_level == CPU_AVX512) i = histogram_avx512(d, n, count);
+    else if (cpu_level == CPU_AVX2) i = histogram_avx2(d, n, count);
+#endif
+    for (; i < n; ++i) ++count[d[i] - '0'];
+}
+
+/* Upper regularized incomplete gamma Q(a, x), for chi-square p-values. */
+static double gamma_q(double a, double x) {
+    if (x <= 0.0) return 1.0;
+    const double log_prefix = a * std::log(x) - x - std::lgamma(a);
+    if (x < a + 1.0) {
+        // series for P(a, x)
+        double term = 1.0 / a, sum = term;
+        for (int n = 1; n < 1000 && term > sum * 1e-15; ++n) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return 1.0 - sum * std::exp(log_prefix);
+    }
+    // continued fraction for Q(a, x) (modified Lentz)
+    const double tiny = 1e-300;
+    double b = x + 1.0 - a, c = 1.0 / tiny, d = 1.0 / b, h = d;
+    for (int i = 1; i < 1000; ++i) {
+        double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1.0) < 1e-15) break;
+    }
+    return std::exp(log_prefix) * h;
+}
+
+/* " name chi2 (p=...)" for observed counts against cell probabilities. */
+static void print_chi2(std::ostream &os, const char *name, const std::uint64_t *obs,
+                       const double *prob, unsigned cells) {
+    double total = 0.0;
+    for (unsigned i = 0; i < cells; ++i) total += static_cast<double>(obs[i]);
+    os << "  " << name << ' ';
+    if (total == 0.0) {
+        os << "n/a";
+        return;
+    }
+    double chi2 = 0.0;
+    for (unsigned i = 0; i < cells; ++i) {
+        double expected = total * prob[i];
+        double diff = static_cast<double>(obs[i]) - expected;
+        chi2 += diff * diff / expected;
+    }
+    os << chi2 << " (p=" << gamma_q((cells - 1) / 2.0, chi2 / 2.0) << ')';
+}
+
+struct StatsSink : DigitSink {
+    explicit StatsSink(unsigned long block_digits) : block(block_digits) {
+        for (unsigned i = 0; i < 10; ++i) freq_prob[i] = 0.1;
+        for (unsigned i = 0; i < 100; ++i) pair_prob[i] = 0.01;
+        // hands with k distinct digits: S(5,k) * 10!/(10-k)! / 10^5
+        const double poker[5] = {1e-4, 0.0135, 0.18, 0.504, 0.3024};
+        for (unsigned i = 0; i < 5; ++i) poker_prob[i] = poker[i];
+        // gap g between repeats is geometric: 0.1 * 0.9^g
+        double p = 0.1;
+        for (unsigned g = 0; g + 1 < STATS_GAP_CELLS; ++g, p *= 0.9) gap_prob[g] = p;
+        gap_prob[STATS_GAP_CELLS - 1] = p / 0.1;
+        for (std::uint64_t &l : last_seen) l = NEVER;
+    }
+
+    void feed(const char *d, std::size_t n) override {
+        while (n > 0) {
+            std::size_t take = static_cast<std::size_t>(
+                std::min<std::uint64_t>(n, block - cur.digits));
+            scan(d, take);
+            d += take;
+            n -= take;
+            if (cur.digits == block) flush_block();
+        }
+    }
+
+    void finish() override {
+        if (cur.digits > 0) flush_block();
+        std::cout << "Statistics, chi-square (p-value), blocks of " << block << " digits:\n"
+                  << report.str();
+        std::cout << "All " << total.digits << " digits:";
+        print_counts(std::cout, total);
+        std::cout << '\n';
+    }
+
+private:
+    static const std::uint64_t NEVER = ~std::uint64_t(0);
+
+    void scan(const char *d, std::size_t n) {
+        histogram_digits(d, n, cur.freq);
+        std::size_t i = 0;
+        // one digit at a time until the kernels' preconditions hold
+        while (i < n && (i < STATS_GAP_CELLS - 1 || seen < 10 || pos % 10 != 0)) step(d[i++]);
+        if (i < n) {
+            const std::size_t from = i;
+            i = pattern_counts(d, i, n, cur);
+            pos += i - from;
+            // last positions of the digits the kernel went over
+            unsigned found = 0;
+            bool done[10] = {};
+            for (std::size_t j = i; j > from && found < 10; --j) {
+                unsigned v = static_cast<unsigned>(d[j - 1] - '0');
+                if (done[v]) continue;
+                done[v] = true;
+                ++found;
+                last_seen[v] = pos - (i - (j - 1));
+            }
+        }
+        while (i < n) step(d[i++]);
+        cur.digits += n;
+    }
+
+    void step(char c) {
+        unsigned v = static_cast<unsigned>(c - '0');
+        if (pos & 1) ++cur.pairs[pair_first * 10 + v];
+        else pair_first = v;
+
+        hand |= 1u << v;
+        if (++hand_len == 5) {
+            ++cur.poker[__builtin_popcount(hand) - 1];
+            hand = 0;
+            hand_len = 0;
+        }
+
+        if (last_seen[v] != NEVER) {
+            std::uint64_t g = pos - last_seen[v] - 1;
+            ++cur.gaps[std::min<std::uint64_t>(g, STATS_GAP_CELLS - 1)];
+        } else {
+            ++seen;
+        }
+        last_seen[v] = pos++;
+    }
+
+    void flush_block() {
+        ++blocks;
+        report << "Block " << blocks << " (digits " << pos - cur.digits + 1
+               << ".." << pos << "):";
+        print_counts(report, cur);
+        report << '\n';
+        total.add(cur);
+        cur = DigitCounts();
+    }
+
+    void print_counts(std::ostream &os, const DigitCounts &c) const {
+        print_chi2(os, "freq", c.freq, freq_prob, 10);
+        print_chi2(os, "pairs", c.pairs, pair_prob, 100);
+        print_chi2(os, "poker", c.poker, poker_prob, 5);
+        print_chi2(os, "gap", c.gaps, gap_prob, STATS_GAP_CELLS);
+    }
+
+    std::uint64_t block;
+    DigitCounts cur, total;
+    std::uint64_t pos = 0;      // digits consumed so far
+    unsigned long blocks = 0;
+    unsigned pair_first = 0;
+    unsigned hand = 0, hand_len = 0;   // hand_len == pos % 5
+    std::uint64_t last_seen[10];
+    unsigned seen = 0;                 // digit values with a last_seen
+    double freq_prob[10], pair_prob[100], poker_prob[5], gap_prob[STATS_GAP_CELLS];
+    std::ostringstream report;
+};
+
+/* =========================
+   Pattern search
+   ========================= */
+
+/*
+ * --search: first occurrence of each of many digit strings, found by an
+ * Aho-Corasick automaton run over the output chunks. The automaton is
+ * a complete DFA over '0'..'9', so its state simply carries over from
+ * one chunk to the next and matches across chunk boundaries need no
+ * special handling. Positions count from 1 at the first digit after
+ * the point.
+ */
+
+struct SearchSink : DigitSink {
+    SearchSink(const std::vector<std::string> &pats, std::uint64_t first_position)
+        : patterns(pats), first(pats.size(), NOT_FOUND), pos(first_position) {
+        build();
+        remaining = patterns.size();
+    }
+
+    void feed(const char *d, std::size_t n) override {
+        std::uint32_t s = state;
+        for (std::size_t i = 0; i < n && remaining > 0; ++i) {
+            s = next[s * 10 + static_cast<unsigned>(d[i] - '0')];
+            if (live[s]) report(s, pos + i);
+        }
+        state = s;
+        pos += n;
+    }
+
+    void finish() override {
+        std::ostringstream out;
+        for (std::size_t i = 0; i < patterns.size(); ++i) {
+            out << patterns[i] << ": ";
+            if (first[i] == NOT_FOUND) out << "not found\n";
+            else out << "first at digit " << first[i] << '\n';
+        }
+        std::cout << out.str();
+    }
+
+private:
+    static const std::uint64_t NOT_FOUND = 0;
+
+    void build() {
+        // trie
+        next.assign(10, 0);
+        ends.emplace_back();
+        for (std::size_t p = 0; p < patterns.size(); ++p) {
+            std::uint32_t s = 0;
+            for (char c : patterns[p]) {
+                unsigned v = static_cast<unsigned>(c - '0');
+                if (next[s * 10 + v] == 0) {
+                    next[s * 10 + v] = static_cast<std::uint32_t>(ends.size());
+                    next.resize(next.size() + 10, 0);
+                    ends.emplace_back();
+                }
+                s = next[s * 10 + v];
+            }
+            ends[s].push_back(static_cast<std::uint32_t>(p));
+        }
+
+        // failure links in BFS order, turning the trie into a DFA
+        const std::size_t states = ends.size();
+        std::vector<std::uint32_t> fail(states, 0), queue;
+        dict.assign(states, 0);
+        for (unsigned v = 0; v < 10; ++v) {
+            if (next[v] != 0) queue.push_back(next[v]);
+        }
+        for (std::size_t qi = 0; qi < queue.size(); ++qi) {
+            std::uint32_t s = queue[qi];
+            std::uint32_t f = fail[s];
+            dict[s] = ends[f].empty() ? dict[f] : f;
+            for (unsigned v = 0; v < 10; ++v) {
+                std::uint32_t &t = next[s * 10 + v];
+                if (t != 0) {
+                    fail[t] = next[f * 10 + v];
+                    queue.push_back(t);
+                } else {
+                    t = next[f * 10 + v];
+                }
+            }
+        }
+
+        live.assign(states, 0);
+        for (std::size_t s = 1; s < states; ++s) {
+            live[s] = !ends[s].empty() || dict[s] != 0;
+        }
+    }
+
+    /*
+     * Record every pattern ending at digit `at` in state s. A state goes
+     * dead once all patterns on its dictionary chain have been seen.
+     */
+    void report(std::uint32_t s, std::uint64_t at) {
+        for (std::uint32_t t = s; t != 0 && live[t]; t = dict[t]) {
+            for (std::uint32_t p : ends[t]) {
+                if (first[p] != NOT_FOUND) continue;
+                first[p] = at + 1 - patterns[p].size();
+                --remaining;
+            }
+            live[t] = 0;
+        }
+    }
+
+    std::vector<std::string> patterns;
+    std::vector<std::uint64_t> first;   // 1-based position, 0 = not yet
+    std::vector<std::uint32_t> next;    // DFA, 10 entries per state
+    std::vector<std::uint32_t> dict;    // nearest proper suffix state with matches
+    std::vector<std::vector<std::uint32_t>> ends;
+    std::vector<char> live;             // state may still report a new match
+    std::size_t remaining = 0;
+    std::uint32_t state = 0;
+    std::uint64_t pos;                  // position of the next digit
+};
+
+/* =========================
+   Digit digests
+   ========================= */
+
+/*
+ * Every run digests the digits it prints (the fraction, or the --range
+ * window) with XXH3-64 (seed 0) and SHA-256 as they pass through the
+ * output pipeline. Both are streaming: XXH3 consumes a 64-byte stripe
+ * as soon as at least one byte follows it, keeps the last 64 bytes for
+ * the final stripe, and keeps the first 240 bytes for the short-input
+ * variants. --self-check compares the digests with PI_REFERENCE_HASHES.
+ */
+
+static std::uint64_t read_le64(const unsigned char *p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static std::uint32_t read_le32(const unsigned char *p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static const std::uint64_t XXH_PRIME32_1 = 0x9E3779B1U;
+static const std::uint64_t XXH_PRIME32_2 = 0x85EBCA77U;
+static const std::uint64_t XXH_PRIME32_3 = 0xC2B2AE3DU;
+static const std::uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const std::uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const std::uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const std::uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const std::uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static const unsigned char XXH3_SECRET[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static std::uint64_t xxh_mul128_fold64(std::uint64_t a, std::uint64_t b) {
+    unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+    return static_cast<std::uint64_t>(p) ^ static_cast<std::uint64_t>(p >> 64);
+}
+
+static std::uint64_t xxh_rotl64(std::uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static std::uint64_t xxh64_avalanche(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static std::uint64_t xxh3_avalanche(std::uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+static std::uint64_t xxh3_mix16(const unsigned char *in, const unsigned char *secret) {
+    return xxh_mul128_fold64(read_le64(in) ^ read_le64(secret),
+                             read_le64(in + 8) ^ read_le64(secret + 8));
+}
+
+/* XXH3-64 of inputs up to 240 bytes, seed 0. */
+static std::uint64_t xxh3_short(const unsigned char *in, std::size_t len) {
+    const unsigned char *s = XXH3_SECRET;
+    if (len == 0) return xxh64_avalanche(read_le64(s + 56) ^ read_le64(s + 64));
+    if (len <= 3) {
+        std::uint32_t combined = (static_cast<std::uint32_t>(in[0]) << 16) |
+                                 (static_cast<std::uint32_t>(in[len >> 1]) << 24) |
+                                 in[len - 1] | static_cast<std::uint32_t>(len << 8);
+        std::uint64_t flip = read_le32(s) ^ read_le32(s + 4);
+        return xxh64_avalanche(combined ^ flip);
+    }
+    if (len <= 8) {
+        std::uint64_t flip = read_le64(s + 8) ^ read_le64(s + 16);
+        std::uint64_t input = read_le32(in + len - 4) +
+                              (static_cast<std::uint64_t>(read_le32(in)) << 32);
+        std::uint64_t h = input ^ flip;
+        h ^= xxh_rotl64(h, 49) ^ xxh_rotl64(h, 24);
+        h *= 0x9FB21C651E98DF25ULL;
+        h ^= (h >> 35) + len;
+        h *= 0x9FB21C651E98DF25ULL;
+        return h ^ (h >> 28);
+    }
+    if (len <= 16) {
+        std::uint64_t lo = read_le64(in) ^ (read_le64(s + 24) ^ read_le64(s + 32));
+        std::uint64_t hi = read_le64(in + len - 8) ^ (read_le64(s + 40) ^ read_le64(s + 48));
+        std::uint64_t acc = len + __builtin_bswap64(lo) + hi + xxh_mul128_fold64(lo, hi);
+        return xxh3_avalanche(acc);
+    }
+    std::uint64_t acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(in + 48, s + 96);
+                    acc += xxh3_mix16(in + len - 64, s + 112);
+                }
+                acc += xxh3_mix16(in + 32, s + 64);
+                acc += xxh3_mix16(in + len - 48, s + 80);
+            }
+            acc += xxh3_mix16(in + 16, s + 32);
+            acc += xxh3_mix16(in + len - 32, s + 48);
+        }
+        acc += xxh3_mix16(in, s);
+        acc += xxh3_mix16(in + len - 16, s + 16);
+        return xxh3_avalanche(acc);
+    }
+    for (unsigned i = 0; i < 8; ++i) acc += xxh3_mix16(in + 16 * i, s + 16 * i);
+    std::uint64_t acc_end = xxh3_mix16(in + len - 16, s + 136 - 17);
+    acc = xxh3_avalanche(acc);
+    for (unsigned i = 8; i < len / 16; ++i) acc_end += xxh3_mix16(in + 16 * i, s + 16 * (i - 8) + 3);
+    return xxh3_avalanche(acc + acc_end);
+}
+
+struct Xxh3Stream {
+    void update(const unsigned char *p, std::size_t n) {
+        if (total < 240) {
+            std::size_t take = std::min<std::size_t>(n, 240 - total);
+            std::memcpy(head + total, p, take);
+        }
+        total += n;
+        while (n > 0) {
+            // a stripe is consumed only once a byte after it is known
+            if (pending_len == 64) {
+                stripe(pending);
+                std::memcpy(last, pending, 64);
+                pending_len = 0;
+            }
+            if (pending_len == 0 && n > 64) {
+                for (; n > 64; p += 64, n -= 64) stripe(p);
+                std::memcpy(last, p - 64, 64);
+                continue;
+            }
+            std::size_t take = std::min<std::size_t>(64 - pending_len, n);
+            std::memcpy(pending + pending_len, p, take);
+            pending_len += take;
+            p += take;
+            n -= take;
+        }
+    }
+
+    std::uint64_t digest() const {
+        if (total <= 240) return xxh3_short(head, static_cast<std::size_t>(total));
+        std::uint64_t a[8];
+        std::memcpy(a, acc, sizeof a);
+        unsigned char tail[64];
+        std::memcpy(tail, last + pending_len, 64 - pending_len);
+        std::memcpy(tail + 64 - pending_len, pending, pending_len);
+        accumulate(a, tail, XXH3_SECRET + 192 - 64 - 7);
+
+        std::uint64_t h = total * XXH_PRIME64_1;
+        for (unsigned i = 0; i < 4; ++i) {
+            h += xxh_mul128_fold64(a[2 * i] ^ read_le64(XXH3_SECRET + 11 + 16 * i),
+                                   a[2 * i + 1] ^ read_le64(XXH3_SECRET + 11 + 16 * i + 8));
+        }
+        return xxh3_avalanche(h);
+    }
+
+private:
+    static void accumulate(std::uint64_t a[8], const unsigned char *in, const unsigned char *secret) {
+        for (unsigned i = 0; i < 8; ++i) {
+            std::uint64_t v = read_le64(in + 8 * i);
+            std::uint64_t k = v ^ read_le64(secret + 8 * i);
+            a[i ^ 1] += v;
+            a[i] += (k & 0xFFFFFFFFULL) * (k >> 32);
+        }
+    }
+
+    void stripe(const unsigned char *in) {
+        accumulate(acc, in, XXH3_SECRET + 8 * stripes);
+        if (++stripes == 16) {
+            for (unsigned i = 0; i < 8; ++i) {
+                std::uint64_t x = acc[i];
+                x ^= x >> 47;
+                x ^= read_le64(XXH3_SECRET + 128 + 8 * i);
+                acc[i] = x * XXH_PRIME32_1;
+            }
+            stripes = 0;
+        }
+    }
+
+    std::uint64_t acc[8] = {XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+                            XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1};
+    unsigned stripes = 0;
+    unsigned char head[240];
+    unsigned char last[64];         // the last consumed stripe
+    unsigned char pending[64];
+    std::size_t pending_len = 0;
+    std::uint64_t total = 0;
+};
+
+static const std::uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+struct Sha256Stream {
+    void update(const unsigned char *p, std::size_t n) {
+        total += n;
+        if (buffered > 0) {
+            std::size_t take = std::min<std::size_t>(64 - buffered, n);
+            std::memcpy(buffer + buffered, p, take);
+            buffered += take;
+            p += take;
+            n -= take;
+            if (buffered < 64) return;
+            block(buffer);
+            buffered = 0;
+        }
+        for (; n >= 64; p += 64, n -= 64) block(p);
+        std::memcpy(buffer, p, n);
+        buffered = n;
+    }
+
+    std::string hex_digest() const {
+        Sha256Stream s = *this;
+        std::uint64_t bits = total * 8;
+        unsigned char pad[72] = {0x80};
+        std::size_t pad_len = (buffered < 56 ? 56 : 120) - buffered;
+        for (unsigned i = 0; i < 8; ++i) pad[pad_len + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        s.update(pad, pad_len + 8);
+
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        for (std::uint32_t word : s.h) {
+            for (int shift = 28; shift >= 0; shift -= 4) out += hex[(word >> shift) & 15];
+        }
+        return out;
+    }
+
+private:
+    static std::uint32_t rotr(std::uint32_t x, unsigned r) { return (x >> r) | (x << (32 - r)); }
+
+    void block(const unsigned char *p) {
+        std::uint32_t w[64];
+        for (unsigned i = 0; i < 16; ++i) {
+            w[i] = static_cast<std::uint32_t>(p[4 * i]) << 24 | static_cast<std::uint32_t>(p[4 * i + 1]) << 16 |
+                   static_cast<std::uint32_t>(p[4 * i + 2]) << 8 | p[4 * i + 3];
+        }
+        for (unsigned i = 16; i < 64; ++i) {
+            std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        std::uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+        for (unsigned i = 0; i < 64; ++i) {
+            std::uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+                               ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) +
+                               ((a & b) ^ (a & c) ^ (b & c));
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+
+    std::uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char buffer[64];
+    std::size_t buffered = 0;
+    std::uint64_t total = 0;
+};
+
+/* Digests of the first 10^k fraction digits of pi, checked against independent runs. */
+struct ReferenceHash {
+    unsigned long digits;
+    std::uint64_t xxh3;
+    const char *sha256;
+};
+
+static const ReferenceHash PI_REFERENCE_HASHES[] = {
+    {1UL, 0x65cd25028f98f158ULL,
+     "6b86b273ff34fce19d6b804eff5a3f5747ada4eaa22f1d49c01e52ddb7875b4b"},
+    {10UL, 0x3107759a6f6c1cb2ULL,
+     "66181a051b887271f036c64620bce3225af7d38f9e3f4a16dfc55de7d351f44b"},
+    {100UL, 0xd414c001c34071f2ULL,
+     "29ace0d6be6c4ca75334c31019bf43fb23c69717adcb42994880b68af651196a"},
+    {1000UL, 0xdd926421d0fd9b5fULL,
+     "808b01bd3137f0fd50877c7ad44b2a97478666390780372803859749172292bd"},
+    {10000UL, 0x75ba0ef3eeecb18bULL,
+     "7406a2be66766f832c8d1e1b66491ef7b2f366b0393d21c4684181044b507ab5"},
+    {100000UL, 0x0913b4f822816c4cULL,
+     "5ebe8007d764bce33aba7a85a0da0924e96663fbb2e0fd089b9e8cd3be482bc2"},
+    {1000000UL, 0x66bdf1cfb16f6d0cULL,
+     "7806ee47461b49ef1f578e14461b2c83c09c6d7a9a914275da1d71e9cbbf7069"},
+    {10000000UL, 0x614bb146d1bdb04cULL,
+     "c3d3dd4bd5d1051fd5995db983eb898ac0308189a20c46e80e5f67d5f415edf1"},
+    {100000000UL, 0xdacfa890067bf1e1ULL,
+     "413258dd0311891fe0ea61ff843dfec5d3ce81155f5ac0a0baea41a03b3d18fe"},
+};
+
+struct DigestSink : DigitSink {
+    void feed(const char *d, std::size_t n) override {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(d);
+        xxh3.update(p, n);
+        sha256.update(p, n);
+    }
+
+    void finish() override {
+        char hex[17];
+        std::snprintf(hex, sizeof hex, "%016llx", static_cast<unsigned long long>(xxh3.digest()));
+        xxh3_hex = hex;
+        sha256_hex = sha256.hex_digest();
+        std::cout << "Digest: xxh3 " << xxh3_hex << ", sha256 " << sha256_hex << '\n';
+    }
+
+    /* Compare with the reference for `digits` digits of pi; false if unknown or different. */
+    bool self_check(unsigned long digits) const {
+        for (const ReferenceHash &r : PI_REFERENCE_HASHES) {
+            if (r.digits != digits) continue;
+            bool ok = std::strtoull(xxh3_hex.c_str(), nullptr, 16) == r.xxh3 &&
+                      sha256_hex == r.sha256;
+            std::cout << "Self-check: " << (ok ? "OK" : "FAILED")
+                      << " against the reference digests for " << digits << " digits\n";
+            return ok;
+        }
+        std::cout << "Self-check: no reference digests for " << digits
+                  << " digits (available for pi at powers of ten up to "
+                  << std::end(PI_REFERENCE_HASHES)[-1].digits << ")\n";
+        return false;
+    }
+
+private:
+    Xxh3Stream xxh3;
+    Sha256Stream sha256;
+    std::string xxh3_hex, sha256_hex;
+};
+
+/* =========================
+   Digit extraction
+   ========================= */
+
+/*
+ * Nine decimal digits of pi starting at position n (1 = first digit
+ * after the point), without computing the digits before them.
+ * This is Bellard's O(n^2) variant of Plouffe's algorithm on
+ *
+ *   pi + 3 = sum_{k>=1} k 2^k k!^2 / (2k)! = sum_{k>=1} k k! / (2k-1)!!
+ *
+ * For every odd prime a <= 2N the terms are summed modulo a^v (the
+ * largest power of a below 2N), giving the a-part of the fractional
+ * part of 10^(n-1) (pi + 3). Each part is floored to a 64-bit binary
+ * fraction and the parts add up with wrapping 64-bit adds, which is
+ * exact modulo 1 and the same in any order; the sum is low by less
+ * than one unit per prime plus the tail past N, and only the digits
+ * that bound cannot move are printed. The primes come
+ * from a segmented sieve: the workers take windows of odd numbers in
+ * turn, sieve each with the primes up to sqrt(2N) and sum the primes
+ * left in it, so memory stays at the base primes plus a window each.
+ */
+
+// Odd numbers per sieve window, at most.
+static const std::uint64_t EXTRACT_WINDOW = 1 << 17;
+
+static std::uint64_t mul_mod(std::uint64_t a, std::uint64_t b, std::uint64_t m) {
+    return static_cast<std::uint64_t>(static_cast<unsigned __int128>(a) * b % m);
+}
+
+static std::uint64_t pow_mod(std::uint64_t b, std::uint64_t e, std::uint64_t m) {
+    std::uint64_t r = 1 % m;
+    b %= m;
+    while (e) {
+        if (e & 1) r = mul_mod(r, b, m);
+        b = mul_mod(b, b, m);
+        e >>= 1;
+    }
+    return r;
+}
+
+/* x^-1 mod m, x coprime to m */
+static std::uint64_t inv_mod(std::uint64_t x, std::uint64_t m) {
+    __int128 t = 0, new_t = 1;
+    __int128 r = m, new_r = x % m;
+    while (new_r != 0) {
+        __int128 q = r / new_r;
+        __int128 tmp = t - q * new_t;
+        t = new_t;
+        new_t = tmp;
+        tmp = r - q * new_r;
+        r = new_r;
+        new_r = tmp;
+    }
+    if (t < 0) t += m;
+    return static_cast<std::uint64_t>(t);
+}
+
+/* Fractional contribution of prime a to 10^(n-1) (pi + 3), floored to
+ * units of 2^-64. */
+static std::uint64_t extract_prime_part(std::uint64_t a, std::uint64_t N, std::uint64_t n) {
+    unsigned vmax = 0;
+    std::uint64_t av = 1;
+    while (av <= 2 * N / a) {
+        av *= a;
+        ++vmax;
+    }
+
+    std::uint64_t s = 0, num = 1, den = 1, kq = 1, kq2 = 1;
+    long v = 0;
+    for (std::uint64_t k = 1; k <= N; ++k) {
+        // k! and (2k-1)!! with the powers of a taken out into v
+        std::uint64_t t = k;
+        if (kq >= a) {
+            do {
+                t /= a;
+                --v;
+            } while (t % a == 0);
+            kq = 0;
+        }
+        ++kq;
+        num = mul_mod(num, t, av);
+
+        t = 2 * k - 1;
+        if (kq2 >= a) {
+            if (kq2 == a) {
+                do {
+                    t /= a;
+                    ++v;
+                } while (t % a == 0);
+            }
+            kq2 -= a;
+        }
+        den = mul_mod(den, t, av);
+        kq2 += 2;
+
+        if (v > 0) {
+            t = mul_mod(inv_mod(den, av), num, av);
+            t = mul_mod(t, k, av);
+            for (long i = v; i < static_cast<long>(vmax); ++i) t = mul_mod(t, a, av);
+            s += t;
+            if (s >= av) s -= av;
+        }
+    }
+
+    s = mul_mod(s, pow_mod(10, n - 1, av), av);
+    return static_cast<std::uint64_t>((static_cast<unsigned __int128>(s) << 64) / av);
+}
+
+/* Up to nine digits at position n: those the error bound of the sum
+ * cannot change (fewer only when pi is that close to a digit boundary). */
+static std::string extract_digits(unsigned long n, unsigned threads) {
+    // The terms past N are below 2 k^1.5 2^-k, so their sum times
+    // 10^(n-1) stays under one unit of 2^-64 with these 68 bits.
+    const std::uint64_t N = static_cast<std::uint64_t>(
+        (n - 1) * 3.321928094887362 + 68 + 1.5 * std::log2(4.0 * n + 100));
+
+    const std::uint64_t limit = 2 * N;
+
+    // odd base primes up to sqrt(2N)
+    std::uint64_t root = static_cast<std::uint64_t>(std::sqrt(static_cast<double>(limit)));
+    while (root * root > limit) --root;
+    while ((root + 1) * (root + 1) <= limit) ++root;
+    std::vector<std::uint64_t> base;
+    {
+        std::vector<bool> composite(root + 1, false);
+        for (std::uint64_t i = 3; i <= root; i += 2) {
+            if (composite[i]) continue;
+            base.push_back(i);
+            for (std::uint64_t j = i * i; j <= root; j += 2 * i) composite[j] = true;
+        }
+    }
+
+    // windows small enough that every worker gets several
+    std::uint64_t span = limit / (16ULL * threads);
+    span = 2 * std::max<std::uint64_t>(512, std::min(EXTRACT_WINDOW, span / 2));
+    std::atomic<std::uint64_t> next_window(0);
+
+    std::vector<std::uint64_t> sums(threads, 0), primes(threads, 0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            std::vector<bool> composite(span / 2);
+            std::uint64_t sum = 0, count = 0;
+            for (;;) {
+                // odd numbers lo, lo + 2, ... below hi
+                std::uint64_t lo = 3 + next_window.fetch_add(1) * span;
+                if (lo > limit) break;
+                std::uint64_t hi = std::min(lo + span, limit + 1);
+                std::fill(composite.begin(), composite.end(), false);
+                for (std::uint64_t p : base) {
+                    if (p * p >= hi) break;
+                    std::uint64_t j = std::max(p * p, (lo + p - 1) / p * p);
+                    if (j % 2 == 0) j += p;
+                    for (; j < hi; j += 2 * p) composite[(j - lo) / 2] = true;
+                }
+                for (std::uint64_t i = lo; i < hi; i += 2) {
+                    if (!composite[(i - lo) / 2]) {
+                        sum += extract_prime_part(i, N, n);  // wraps: mod 1
+                        ++count;
+                    }
+                }
+            }
+            sums[t] = sum;
+            primes[t] = count;
+        });
+    }
+    for (std::thread &th : pool) th.join();
+
+    // pi's digits lie in [sum, sum + err) units of 2^-64
+    std::uint64_t sum = 0, err = 2;  // the tail and one spare
+    for (unsigned t = 0; t < threads; ++t) {
+        sum += sums[t];
+        err += primes[t];
+    }
+    const unsigned __int128 lo = sum, hi = lo + err;
+    unsigned long pow10 = 1000000000UL;
+    for (int k = 9; k > 0; --k, pow10 /= 10) {
+        unsigned __int128 d = lo * pow10 >> 64;
+        if (d == (hi * pow10 >> 64)) {
+            std::string s = std::to_string(static_cast<unsigned long>(d));
+            return std::string(k - s.size(), '0') + s;
+        }
+    }
+    return std::string();
+}
+
+/* =========================
+   Continued fraction
+   ========================= */
+
+/*
+ * Partial quotients of pi from a half-GCD (Schoenhage's recursive
+ * Lehmer scheme). A pair of n-bit numbers is reduced by running the
+ * half-GCD on its top half, then applying the resulting 2x2 matrix to
+ * the full numbers. Quotients of the truncated pair may differ from the
+ * exact ones near the end, so they are validated on the full pair and
+ * dropped one at a time until the remainders are consistent again.
+ *
+ * pi lies in [S/10^D, (S+1)/10^D] for S = floor(pi 10^D). The quotients
+ * both endpoints share, minus the last, are quotients of pi; if there
+ * are too few of them, D grows and the expansion is redone.
+ */
+
+/* Below this many bits the pair is reduced by plain Euclid steps. */
+static const unsigned long CF_EUCLID_BITS = 4096;
+
+/* average decimal digits per partial quotient (Levy's constant) */
+static const double CF_DIGITS_PER_TERM = 1.0306;
+
+/* (a, b) = M (c, d) for the current pair (c, d) */
+struct CfMatrix {
+    mpz_class m11 = 1, m12 = 0, m21 = 0, m22 = 1;
+};
+
+static void cf_euclid_step(mpz_class &a, mpz_class &b,
+                           std::vector<mpz_class> &q, CfMatrix &M) {
+    mpz_class quot, rem;
+    mpz_fdiv_qr(quot.get_mpz_t(), rem.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+    // M <- M [[quot, 1], [1, 0]]
+    mpz_class t = M.m11;
+    M.m11 = quot * M.m11 + M.m12;
+    M.m12 = t;
+    t = M.m21;
+    M.m21 = quot * M.m21 + M.m22;
+    M.m22 = t;
+    a.swap(b);
+    b.swap(rem);
+    q.push_back(std::move(quot));
+}
+
+/*
+ * Reduce a > b > 0 until b has at most bits(a)/2 + 1 bits, appending
+ * the quotients to q and accumulating their matrix into M.
+ */
+static void cf_half_gcd(mpz_class &a, mpz_class &b,
+                        std::vector<mpz_class> &q, CfMatrix &M) {
+    const unsigned long h = mpz_sizeinbase(a.get_mpz_t(), 2) / 2 + 1;
+
+    while (b > 0 && mpz_sizeinbase(b.get_mpz_t(), 2) > h) {
+        const unsigned long n = mpz_sizeinbase(a.get_mpz_t(), 2);
+        if (n < CF_EUCLID_BITS) {
+            cf_euclid_step(a, b, q, M);
+            continue;
+        }
+
+        // reduce the top of the pair by about (n - h) bits
+        unsigned long s = std::max(n / 2, n > 2 * (n - h) ? n - 2 * (n - h) : 0UL);
+        mpz_class ta = a >> s, tb = b >> s;
+        CfMatrix S;
+        std::size_t first = q.size();
+        if (tb > 0) cf_half_gcd(ta, tb, q, S);
+
+        // (c, d) = S^-1 (a, b); det S = (-1)^count
+        mpz_class c = S.m22 * a - S.m12 * b;
+        mpz_class d = S.m11 * b - S.m21 * a;
+        if ((q.size() - first) & 1) {
+            c = -c;
+            d = -d;
+        }
+        // drop quotients the full pair does not agree with
+        while (q.size() > first &&
+               (d <= 0 || c <= d || mpz_sizeinbase(c.get_mpz_t(), 2) <= h)) {
+            mpz_class quot = std::move(q.back());
+            q.pop_back();
+            mpz_class t = quot * c + d;
+            d = c;
+            c = t;
+            // S <- S [[0, 1], [1, -quot]]
+            t = S.m11;
+            S.m11 = S.m12;
+            S.m12 = t - quot * S.m12;
+            t = S.m21;
+            S.m21 = S.m22;
+            S.m22 = t - quot * S.m22;
+        }
+        if (q.size() == first) {
+            cf_euclid_step(a, b, q, M);
+            continue;
+        }
+
+        // M <- M S
+        mpz_class t11 = M.m11 * S.m11 + M.m12 * S.m21;
+        mpz_class t12 = M.m11 * S.m12 + M.m12 * S.m22;
+        mpz_class t21 = M.m21 * S.m11 + M.m22 * S.m21;
+        mpz_class t22 = M.m21 * S.m12 + M.m22 * S.m22;
+        M.m11.swap(t11);
+        M.m12.swap(t12);
+        M.m21.swap(t21);
+        M.m22.swap(t22);
+        a.swap(c);
+        b.swap(d);
+    }
+}
+
+/* All partial quotients of a/b, for a, b > 0. */
+static std::vector<mpz_class> cf_expand(mpz_class a, mpz_class b) {
+    std::vector<mpz_class> q;
+    CfMatrix M;
+    if (a < b) {
+        q.push_back(0);
+        a.swap(b);
+    }
+    while (b > 0) {
+        if (mpz_sizeinbase(a.get_mpz_t(), 2) < CF_EUCLID_BITS) {
+            cf_euclid_step(a, b, q, M);
+        } else {
+            // M only matters inside the recursion
+            M = CfMatrix();
+            cf_half_gcd(a, b, q, M);
+        }
+    }
+    return q;
+}
+
+/* The first `count` partial quotients of pi. */
+static std::vector<mpz_class> pi_continued_fraction(unsigned long count,
+                                                    const Options &opts) {
+    unsigned long digits = static_cast<unsigned long>(count * CF_DIGITS_PER_TERM * 1.05) + 40;
+    for (;;) {
+        mpz_class S, den;
+        compute_pi(digits, opts, S);
+        progress_phase(PHASE_CF);
+        mpz_ui_pow_ui(den.get_mpz_t(), 10, digits);
+
+        std::vector<mpz_class> lo = cf_expand(S, den);
+        std::vector<mpz_class> hi = cf_expand(S + 1, den);
+        std::size_t common = 0;
+        std::size_t limit = std::min(lo.size(), hi.size()) - 1;
+        while (common < limit && lo[common] == hi[common]) ++common;
+
+        if (common >= count) {
+            lo.resize(count);
+            return lo;
+        }
+        std::cout << "Only " << common << " terms at " << digits
+                  << " digits, retrying with more\n";
+        digits = digits + digits / 4 + 40;
+    }
+}
+
+/* =========================
+   Embedded digit table
+   ========================= */
+
+/*
+ * Requests for at most PI_TABLE_DIGITS digits of pi are answered from
+ * the table in pi_digits_table.h with a single write(2): no bignum work
+ * at all. The table is generated by this program:
+ *
+ *   ./pi_chudnovsky_cpp --emit-table 10000 > pi_digits_table.h
+ */
+static_assert(sizeof(PI_TABLE_FRACTION) == PI_TABLE_DIGITS + 1,
+              "pi_digits_table.h: PI_TABLE_DIGITS does not match the table");
+
+static bool write_all(int fd, const char *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len  -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/* Same output as the computed path, assembled into one buffer. */
+static int print_from_table(const Options &opts, unsigned long digits,
+                            std::chrono::high_resolution_clock::time_point start,
+                            const std::vector<DigitSink *> &sinks, bool echo) {
+    std::string out = opts.range_len != 0
+        ? "Calculating pi digits " + std::to_string(opts.range_start + 1) + ".." +
+          std::to_string(digits) + " (C++, embedded table)...\n"
+        : "Calculating pi to " + std::to_string(digits) +
+          " digits (C++, embedded table)...\n";
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::ostringstream time_line;
+    time_line << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+    out += time_line.str();
+
+    const char *fraction = PI_TABLE_FRACTION + opts.range_start;
+    std::size_t len = opts.range_len != 0 ? opts.range_len : digits;
+    if (echo) {
+        if (opts.range_len == 0) out += "3.";
+        out.append(fraction, len);
+        out += '\n';
+    }
+    if (!write_all(STDOUT_FILENO, out.data(), out.size())) return 1;
+
+    for (DigitSink *sink : sinks) sink->feed(fraction, len);
+    for (DigitSink *sink : sinks) sink->finish();
+    return 0;
+}
+
+/* Exit status for --self-check (0 when not requested). */
+static int self_check_status(const Options &opts, const DigestSink &digest, unsigned long digits) {
+    if (!opts.self_check) return 0;
+    if (opts.root_degree != 0 || opts.constant != "pi" || opts.range_len != 0) {
+        std::cout << "Self-check: reference digests exist only for full pi runs\n";
+        return 1;
+    }
+    return digest.self_check(digits) ? 0 : 1;
+}
+
+/* Print the generated header for the first `digits` decimals of pi. */
+static void print_table_header(const mpz_class &scaled, unsigned long digits) {
+    std::string str = scaled.get_str(10);
+
+    std::cout << "/* Generated by: pi_chudnovsky_cpp --emit-table " << digits << "\n"
+              << " * First " << digits << " decimals of pi (after \"3.\"). Do not edit. */\n"
+              << "#pragma once\n\n"
+              << "#include <cstddef>\n\n"
+              << "static constexpr std::size_t PI_TABLE_DIGITS = " << digits << ";\n\n"
+              << "static constexpr char PI_TABLE_FRACTION[] =\n";
+    for (std::size_t i = 1; i < str.size(); i += 100) {
+        std::cout << "    \"" << str.substr(i, 100) << "\"\n";
+    }
+    if (digits == 0) std::cout << "    \"\"\n";
+    std::cout << "    ;\n";
+}
+
+/* =========================
+   Digit files
+   ========================= */
+
+/*
+ * --compare mmaps two digit files and reports how many leading digits
+ * after the point agree. A file is either this program's text output
+ * (header lines, then <int>.<digits>), a bare digit string, or the
+ * packed form written by --pack-digits:
+ *
+ *   "PIDBCD01"  u64 n  |  ceil(n/2) bytes, two digits per byte, high nibble first
+ *
+ * The digits are cut into COMPARE_BLOCK_DIGITS blocks that the workers
+ * take in increasing order; a worker stops once its next block starts
+ * past the earliest mismatch found so far. Packed blocks are compared
+ * byte-wise when both sides are packed, and unpacked otherwise.
+ */
+
+static const char PACKED_MAGIC[8] = {'P', 'I', 'D', 'B', 'C', 'D', '0', '1'};
+static const std::size_t COMPARE_BLOCK_DIGITS = 1 << 20;
+
+struct DigitFile {
+    void *map = MAP_FAILED;
+    std::size_t size = 0;
+    const unsigned char *data = nullptr; // ASCII digits, or packed pairs
+    std::uint64_t digits = 0;
+    bool packed = false;
+
+    ~DigitFile() {
+        if (map != MAP_FAILED) ::munmap(map, size);
+    }
+};
+
+static bool open_digit_file(const std::string &path, DigitFile &f) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        std::cerr << "Cannot open \"" << path << "\"\n";
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    f.size = static_cast<std::size_t>(st.st_size);
+    if (f.size > 0) f.map = ::mmap(nullptr, f.size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (f.map == MAP_FAILED) {
+        std::cerr << "Cannot map \"" << path << "\"\n";
+        return false;
+    }
+    ::madvise(f.map, f.size, MADV_SEQUENTIAL);
+    const unsigned char *base = static_cast<const unsigned char *>(f.map);
+
+    if (f.size >= 16 && std::memcmp(base, PACKED_MAGIC, sizeof PACKED_MAGIC) == 0) {
+        std::memcpy(&f.digits, base + 8, sizeof f.digits);
+        if (f.size - 16 < (f.digits + 1) / 2) {
+            std::cerr << "\"" << path << "\" is truncated\n";
+            return false;
+        }
+        f.packed = true;
+        f.data = base + 16;
+        return true;
+    }
+
+    // skip header lines up to the first one that starts with a digit
+    const unsigned char *p = base, *end = base + f.size;
+    while (p < end && !(*p >= '0' && *p <= '9')) {
+        const void *nl = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+        p = nl ? static_cast<const unsigned char *>(nl) + 1 : end;
+    }
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r')) --end;
+    const void *nl = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+    if (nl) end = static_cast<const unsigned char *>(nl);
+    const void *point = std::memchr(p, '.', static_cast<std::size_t>(end - p));
+    if (point) p = static_cast<const unsigned char *>(point) + 1;
+    if (p == end) {
+        std::cerr << "No digits in \"" << path << "\"\n";
+        return false;
+    }
+    f.data = p;
+    f.digits = static_cast<std::uint64_t>(end - p);
+    return true;
+}
+
+#ifdef PI_X86
+/* Whole vectors only: the first mismatch among them, or where they end. */
+PI_TARGET_AVX2
+static std::size_t mismatch_avx2(const unsigned char *a, const unsigned char *b, std::size_t n) {
+    std::size_t i = 0;
+    for (; n - i >= 32; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        unsigned eq = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (eq != 0xFFFFFFFFu) return i + static_cast<std::size_t>(__builtin_ctz(~eq));
+    }
+    return i;
+}
+
+PI_TARGET_AVX512
+static std::size_t mismatch_avx512(const unsigned char *a, const unsigned char *b, std::size_t n) {
+    std::size_t i = 0;
+    for (; n - i >= 64; i += 64) {
+        __mmask64 ne = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+        if (ne != 0) return i + static_cast<std::size_t>(__builtin_ctzll(ne));
+    }
+    return i;
+}
+#endif
+
+/* Index of the first differing byte of a[0..n) and b[0..n), or n. */
+static std::size_t first_mismatch(const unsigned char *a, const unsigned char *b, std::size_t n) {
+    std::size_t i = 0;
+#ifdef PI_X86
+    // a[0..i) are equal; a mismatch at i is found again below
+    if (cpu_level == CPU_AVX512) i = mismatch_avx512(a, b, n);
+    else if (cpu_level == CPU_AVX2) i = mismatch_avx2(a, b, n);
+#endif
+    for (; n - i >= 8; i += 8) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if (x != y) return i + static_cast<std::size_t>(__builtin_ctzll(x ^ y)) / 8;
+    }
+    for (; i < n; ++i) {
+        if (a[i] != b[i]) return i;
+    }
+    return n;
+}
+
+#ifdef PI_X86
+/* BCD bytes to ASCII digit pairs, whole vectors only; returns the digits done. */
+PI_TARGET_AVX2
+static std::size_t unpack_avx2(const unsigned char *src, std::size_t n, unsigned char *out) {
+    const __m256i low4 = _mm256_set1_epi8(0x0F), ascii = _mm256_set1_epi8('0');
+    std::size_t i = 0;
+    for (; n - i >= 64; i += 64) {
+        __m256i x  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i / 2));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low4);
+        __m256i lo = _mm256_and_si256(x, low4);
+        // per 128-bit lane: a = bytes 0-7 | 16-23, b = bytes 8-15 | 24-31
+        __m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+        __m256i first  = _mm256_permute2x128_si256(a, b, 0x20);
+        __m256i second = _mm256_permute2x128_si256(a, b, 0x31);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_add_epi8(first, ascii));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 32), _mm256_add_epi8(second, ascii));
+    }
+    return i;
+}
+
+PI_TARGET_AVX512
+static std::size_t unpack_avx512(const unsigned char *src, std::size_t n, unsigned char *out) {
+    const __m512i low4 = _mm512_set1_epi8(0x0F), ascii = _mm512_set1_epi8('0');
+    // qwords of (a, b) in output order, as for AVX2 but over four lanes
+    const __m512i first_idx  = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i second_idx = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    std::size_t i = 0;
+    for (; n - i >= 128; i += 128) {
+        __m512i x  = _mm512_loadu_si512(src + i / 2);
+        __m512i hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), low4);
+        __m512i lo = _mm512_and_si512(x, low4);
+        __m512i a = _mm512_unpacklo_epi8(hi, lo), b = _mm512_unpackhi_epi8(hi, lo);
+        _mm512_storeu_si512(out + i, _mm512_add_epi8(_mm512_permutex2var_epi64(a, first_idx, b), ascii));
+        _mm512_storeu_si512(out + i + 64, _mm512_add_epi8(_mm512_permutex2var_epi64(a, second_idx, b), ascii));
+    }
+    return i;
+}
+
+/* ASCII digit pairs to BCD bytes; stops at the first vector holding a non-digit. */
+PI_TARGET_AVX2
+static std::size_t pack_avx2(const unsigned char *src, std::size_t n, unsigned char *out) {
+    const __m256i ascii = _mm256_set1_epi8('0'), nine = _mm256_set1_epi8(9);
+    const __m256i weights = _mm256_set1_epi16(0x0110);  // 16 * even digit + odd digit
+    std::size_t i = 0;
+    for (; n - i >= 32; i += 32) {
+        __m256i x = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), ascii);
+        __m256i ok = _mm256_cmpeq_epi8(_mm256_max_epu8(x, nine), nine);
+        if (_mm256_movemask_epi8(ok) != -1) break;
+        __m256i pairs = _mm256_maddubs_epi16(x, weights);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 2), _mm256_castsi256_si128(bytes));
+    }
+    return i;
+}
+
+PI_TARGET_AVX512
+static std::size_t pack_avx512(const unsigned char *src, std::size_t n, unsigned char *out) {
+    const __m512i ascii = _mm512_set1_epi8('0'), nine = _mm512_set1_epi8(9);
+    const __m512i weights = _mm512_set1_epi16(0x0110);
+    std::size_t i = 0;
+    for (; n - i >= 64; i += 64) {
+        __m512i x = _mm512_sub_epi8(_mm512_loadu_si512(src + i), ascii);
+        if (_mm512_cmpgt_epu8_mask(x, nine) != 0) break;
+        __m256i bytes = _mm512_maskz_cvtepi16_epi8(~__mmask32(0), _mm512_maddubs_epi16(x, weights));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i / 2), bytes);
+    }
+    return i;
+}
+#endif
+
+/* ASCII digits [first, first + n) of a packed file (first even). */
+static void unpack_digits(const unsigned char *src, std::uint64_t first, std::size_t n,
+                          unsigned char *out) {
+    src += first / 2;
+    std::size_t i = 0;
+#ifdef PI_X86
+    if (cpu_level == CPU_AVX512) i = unpack_avx512(src, n, out);
+    else if (cpu_level == CPU_AVX2) i = unpack_avx2(src, n, out);
+#endif
+    for (; i < n; ++i) {
+        unsigned char byte = src[i / 2];
+        out[i] = static_cast<unsigned char>('0' + ((i & 1) ? byte & 15 : byte >> 4));
+    }
+}
+
+/* Pack ASCII digits src[0..n) two per byte (a last odd digit gets a 0 low
+ * nibble). Returns the index of the first non-digit, or n. */
+static std::size_t pack_digits(const unsigned char *src, std::size_t n, unsigned char *out) {
+    std::size_t i = 0;
+#ifdef PI_X86
+    if (cpu_level == CPU_AVX512) i = pack_avx512(src, n, out);
+    else if (cpu_level == CPU_AVX2) i = pack_avx2(src, n, out);
+#endif
+    for (; i < n; i += 2) {
+        unsigned hi = src[i] - '0', lo = i + 1 < n ? src[i + 1] - '0' : 0;
+        if (hi > 9) return i;
+        if (lo > 9) return i + 1;
+        out[i / 2] = static_cast<unsigned char>(hi << 4 | lo);
+    }
+    return n;
+}
+
+static unsigned char digit_of(const DigitFile &f, std::uint64_t i) {
+    if (!f.packed) return f.data[i];
+    unsigned char byte = f.data[i / 2];
+    return static_cast<unsigned char>('0' + ((i & 1) ? byte & 15 : byte >> 4));
+}
+
+/* First mismatch within digits [first, first + n), as an offset from first, or n. */
+static std::size_t block_mismatch(const DigitFile &a, const DigitFile &b, std::uint64_t first,
+                                  std::size_t n, std::vector<unsigned char> &buf_a,
+                                  std::vector<unsigned char> &buf_b) {
+    if (a.packed && b.packed) {
+        std::size_t bytes = (n + 1) / 2;
+        std::size_t k = first_mismatch(a.data + first / 2, b.data + first / 2, bytes);
+        if (k == bytes) return n;
+        bool high_equal = (a.data[first / 2 + k] >> 4) == (b.data[first / 2 + k] >> 4);
+        return std::min(2 * k + (high_equal ? 1 : 0), n);
+    }
+    const unsigned char *pa = a.data + first, *pb = b.data + first;
+    if (a.packed) {
+        unpack_digits(a.data, first, n, buf_a.data());
+        pa = buf_a.data();
+    }
+    if (b.packed) {
+        unpack_digits(b.data, first, n, buf_b.data());
+        pb = buf_b.data();
+    }
+    return first_mismatch(pa, pb, n);
+}
+
+static int compare_files(const std::string &path_a, const std::string &path_b,
+                         unsigned threads) {
+    auto start = std::chrono::high_resolution_clock::now();
+    DigitFile a, b;
+    if (!open_digit_file(path_a, a) || !open_digit_file(path_b, b)) return 1;
+
+    std::cout << "Comparing " << path_a << " (" << a.digits << " digits"
+              << (a.packed ? ", packed" : "") << ") with " << path_b << " ("
+              << b.digits << " digits" << (b.packed ? ", packed" : "")
+              << ") (C++, parallel, " << CPU_LEVEL_NAMES[cpu_level] << ")...\n";
+
+    const std::uint64_t common = std::min(a.digits, b.digits);
+    std::atomic<std::uint64_t> next_block(0), mismatch(common);
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < threads; ++w) {
+        pool.emplace_back([&] {
+            std::vector<unsigned char> buf_a(a.packed ? COMPARE_BLOCK_DIGITS : 0);
+            std::vector<unsigned char> buf_b(b.packed ? COMPARE_BLOCK_DIGITS : 0);
+            for (;;) {
+                std::uint64_t first = next_block++ * COMPARE_BLOCK_DIGITS;
+                if (first >= mismatch.load()) break;
+                std::size_t n = static_cast<std::size_t>(
+                    std::min<std::uint64_t>(COMPARE_BLOCK_DIGITS, common - first));
+                std::size_t k = block_mismatch(a, b, first, n, buf_a, buf_b);
+                if (k == n) continue;
+                std::uint64_t at = first + k, seen = mismatch.load();
+                while (at < seen && !mismatch.compare_exchange_weak(seen, at)) {
+                }
+            }
+        });
+    }
+    for (std::thread &th : pool) th.join();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+
+    const std::uint64_t match = mismatch.load();
+    std::cout << "Matching leading digits: " << match << '\n';
+    if (match < common) {
+        std::cout << "First mismatch at digit " << match + 1 << ": " << path_a << " has "
+                  << digit_of(a, match) << ", " << path_b << " has " << digit_of(b, match)
+                  << '\n';
+        return 1;
+    }
+    if (a.digits != b.digits) {
+        std::cout << (a.digits > b.digits ? path_a : path_b) << " continues for "
+                  << std::max(a.digits, b.digits) - common << " more digits\n";
+        return 1;
+    }
+    std::cout << "Files agree on all " << common << " digits\n";
+    return 0;
+}
+
+static int pack_digit_file(const std::string &in_path, const std::string &out_path) {
+    auto start = std::chrono::high_resolution_clock::now();
+    DigitFile in;
+    if (!open_digit_file(in_path, in)) return 1;
+    if (in.packed) {
+        std::cerr << "\"" << in_path << "\" is already packed\n";
+        return 1;
+    }
+
+    int fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create \"" << out_path << "\"\n";
+        return 1;
+    }
+    bool ok = write_all(fd, PACKED_MAGIC, sizeof PACKED_MAGIC) &&
+              write_all(fd, reinterpret_cast<const char *>(&in.digits), sizeof in.digits);
+    std::vector<unsigned char> out(COMPARE_BLOCK_DIGITS / 2);
+    for (std::uint64_t first = 0; ok && first < in.digits; first += COMPARE_BLOCK_DIGITS) {
+        std::size_t n = static_cast<std::size_t>(
+            std::min<std::uint64_t>(COMPARE_BLOCK_DIGITS, in.digits - first));
+        std::size_t bad = pack_digits(in.data + first, n, out.data());
+        if (bad != n) {
+            std::cerr << "Unexpected character at digit " << first + bad + 1
+                      << " of \"" << in_path << "\"\n";
+            ok = false;
+            break;
+        }
+        ok = write_all(fd, reinterpret_cast<const char *>(out.data()), (n + 1) / 2);
+    }
+    ok = ::close(fd) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Failed writing \"" << out_path << "\"\n";
+        return 1;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Packed " << in.digits << " digits into " << out_path << '\n'
+              << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+    return 0;
+}
+
+/* =========================
+   Digit index
+   ========================= */
+
+/*
+ * --build-index turns a digit file into a suffix array for repeated
+ * lookups; --query answers count and first-occurrence queries from it
+ * by binary search over the mmapped index. The matches of a pattern are
+ * a range of suffix-array rows, and the first occurrence is the least
+ * row in it: a range minimum, answered from the minima of blocks of
+ * INDEX_RMQ_BLOCK rows and a sparse table over superblocks of
+ * INDEX_RMQ_BLOCK blocks, so a query reads at most a few hundred
+ * entries. Layout (native endian):
+ *
+ *   "PIDXSA02"  u64 n  |  n digits  |  pad to 8  |  n x u32 suffix array
+ *   |  B = ceil(n/64) x u32 block minima
+ *   |  L x S x u32 sparse table, S = ceil(B/64) superblocks, L = floor(log2 S) + 1
+ *
+ * Suffixes are distributed into buckets by their first INDEX_BUCKET_DIGITS
+ * digits (with a marker for suffixes that end early), and the buckets are
+ * sorted by the worker threads with plain comparisons. Random digits
+ * differ after about log10(n) positions, so the comparisons stay short.
+ * The 32-bit suffix array limits the index to 4G digits.
+ */
+
+static const char INDEX_MAGIC[8] = {'P', 'I', 'D', 'X', 'S', 'A', '0', '2'};
+static const unsigned INDEX_BUCKET_DIGITS = 4;
+static const std::uint64_t INDEX_RMQ_BLOCK = 64;
+
+static std::size_t index_sa_offset(std::uint64_t n) {
+    return static_cast<std::size_t>((16 + n + 7) & ~std::uint64_t(7));
+}
+
+/* Shape of the range-minimum part for n rows. */
+struct IndexRmq {
+    std::uint64_t blocks, supers;
+    unsigned levels;
+
+    explicit IndexRmq(std::uint64_t n)
+        : blocks((n + INDEX_RMQ_BLOCK - 1) / INDEX_RMQ_BLOCK),
+          supers((blocks + INDEX_RMQ_BLOCK - 1) / INDEX_RMQ_BLOCK),
+          levels(supers ? 64 - static_cast<unsigned>(__builtin_clzll(supers)) : 0) {}
+
+    std::uint64_t entries() const { return blocks + levels * supers; }
+};
+
+static std::size_t index_size(std::uint64_t n) {
+    return index_sa_offset(n) + (n + IndexRmq(n).entries()) * sizeof(std::uint32_t);
+}
+
+/* Block minima of sa, then the sparse table over superblock minima. */
+static void index_rmq(const std::vector<std::uint32_t> &sa, std::vector<std::uint32_t> &rmq) {
+    const IndexRmq shape(sa.size());
+    rmq.assign(shape.entries(), UINT32_MAX);
+    std::uint32_t *block = rmq.data(), *table = block + shape.blocks;
+    for (std::size_t i = 0; i < sa.size(); ++i) {
+        std::uint32_t &m = block[i / INDEX_RMQ_BLOCK];
+        m = std::min(m, sa[i]);
+    }
+    for (std::uint64_t b = 0; b < shape.blocks; ++b) {
+        std::uint32_t &m = table[b / INDEX_RMQ_BLOCK];
+        m = std::min(m, block[b]);
+    }
+    // level k, entry i: minimum of superblocks [i, i + 2^k)
+    for (unsigned k = 1; k < shape.levels; ++k) {
+        const std::uint32_t *prev = table + (k - 1) * shape.supers;
+        std::uint32_t *cur = table + k * shape.supers;
+        const std::uint64_t half = std::uint64_t(1) << (k - 1);
+        for (std::uint64_t i = 0; i + 2 * half <= shape.supers; ++i) {
+            cur[i] = std::min(prev[i], prev[i + half]);
+        }
+    }
+}
+
+/* Least suffix-array entry in rows [lo, hi), hi > lo. */
+static std::uint32_t index_first(const std::uint32_t *sa, const std::uint32_t *rmq,
+                                 std::uint64_t n, std::uint64_t lo, std::uint64_t hi) {
+    const IndexRmq shape(n);
+    const std::uint32_t *block = rmq, *table = rmq + shape.blocks;
+    const std::uint64_t B = INDEX_RMQ_BLOCK;
+    std::uint32_t m = UINT32_MAX;
+    auto scan = [&](const std::uint32_t *v, std::uint64_t a, std::uint64_t b) {
+        for (; a < b; ++a) m = std::min(m, v[a]);
+    };
+
+    // whole blocks [blo, bhi), rows around them
+    std::uint64_t blo = (lo + B - 1) / B, bhi = hi / B;
+    if (blo >= bhi) {
+        scan(sa, lo, hi);
+        return m;
+    }
+    scan(sa, lo, blo * B);
+    scan(sa, bhi * B, hi);
+
+    // whole superblocks [slo, shi), blocks around them
+    std::uint64_t slo = (blo + B - 1) / B, shi = bhi / B;
+    if (slo >= shi) {
+        scan(block, blo, bhi);
+        return m;
+    }
+    scan(block, blo, slo * B);
+    scan(block, shi * B, bhi);
+
+    unsigned k = 63 - static_cast<unsigned>(__builtin_clzll(shi - slo));
+    const std::uint32_t *level = table + k * shape.supers;
+    return std::min(m, std::min(level[slo], level[shi - (std::uint64_t(1) << k)]));
+}
+
+/* ASCII digits of a digit file: mapped as they are, unpacked into `buf` when packed. */
+static bool index_digits(const std::string &path, DigitFile &f, std::string &buf,
+                         const char *&digits, std::size_t &n) {
+    if (!open_digit_file(path, f)) return false;
+    if (f.digits > UINT32_MAX) {
+        std::cerr << "Index is limited to " << UINT32_MAX << " digits\n";
+        return false;
+    }
+    n = static_cast<std::size_t>(f.digits);
+    if (f.packed) {
+        buf.resize(n);
+        unpack_digits(f.data, 0, n, reinterpret_cast<unsigned char *>(&buf[0]));
+        digits = buf.data();
+    } else {
+        digits = reinterpret_cast<const char *>(f.data);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        if (digits[i] < '0' || digits[i] > '9') {
+            std::cerr << "Unexpected character in the digits of \"" << path << "\"\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static void index_sort(const char *t, std::size_t n, std::vector<std::uint32_t> &sa,
+                       unsigned threads) {
+
+    // bucket key: first digits in base 11, 0 standing for "past the end"
+    std::size_t buckets = 1;
+    for (unsigned i = 0; i < INDEX_BUCKET_DIGITS; ++i) buckets *= 11;
+    auto key = [&](std::size_t i) {
+        std::size_t k = 0;
+        for (unsigned j = 0; j < INDEX_BUCKET_DIGITS; ++j) {
+            k = k * 11 + (i + j < n ? static_cast<std::size_t>(t[i + j] - '0') + 1 : 0);
+        }
+        return k;
+    };
+
+    std::vector<std::size_t> start(buckets + 1, 0);
+    for (std::size_t i = 0; i < n; ++i) ++start[key(i) + 1];
+    for (std::size_t b = 0; b < buckets; ++b) start[b + 1] += start[b];
+    std::vector<std::size_t> fill(start.begin(), start.end() - 1);
+    sa.resize(n);
+    for (std::size_t i = 0; i < n; ++i) sa[fill[key(i)]++] = static_cast<std::uint32_t>(i);
+
+    // suffixes in one bucket of size > 1 share their first INDEX_BUCKET_DIGITS digits
+    auto less = [&](std::uint32_t a, std::uint32_t b) {
+        std::size_t la = n - a, lb = n - b;
+        std::size_t m = std::min(la, lb);
+        int c = std::memcmp(t + a + INDEX_BUCKET_DIGITS, t + b + INDEX_BUCKET_DIGITS,
+                            m - INDEX_BUCKET_DIGITS);
+        return c != 0 ? c < 0 : la < lb;
+    };
+
+    std::atomic<std::size_t> next_bucket(0);
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < threads; ++w) {
+        pool.emplace_back([&] {
+            for (std::size_t b; (b = next_bucket++) < buckets;) {
+                if (start[b + 1] - start[b] > 1) {
+                    std::sort(sa.begin() + start[b], sa.begin() + start[b + 1], less);
+                }
+            }
+        });
+    }
+    for (std::thread &th : pool) th.join();
+}
+
+static int build_index(const std::string &digit_path, const std::string &index_path,
+                       unsigned threads) {
+    auto start = std::chrono::high_resolution_clock::now();
+    DigitFile file;
+    std::string unpacked;
+    const char *digits;
+    std::size_t n;
+    if (!index_digits(digit_path, file, unpacked, digits, n)) return 1;
+    ::madvise(file.map, file.size, MADV_RANDOM);
+    std::cout << "Indexing " << n << " digits from " << digit_path
+              << " (C++, parallel bucket suffix sort)...\n";
+
+    std::vector<std::uint32_t> sa, rmq;
+    index_sort(digits, n, sa, threads);
+    index_rmq(sa, rmq);
+
+    int fd = ::open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create \"" << index_path << "\"\n";
+        return 1;
+    }
+    std::uint64_t count = n;
+    char pad[8] = {};
+    bool ok = write_all(fd, INDEX_MAGIC, sizeof INDEX_MAGIC) &&
+              write_all(fd, reinterpret_cast<const char *>(&count), sizeof count) &&
+              write_all(fd, digits, n) &&
+              write_all(fd, pad, index_sa_offset(n) - 16 - n) &&
+              write_all(fd, reinterpret_cast<const char *>(sa.data()),
+                        sa.size() * sizeof(std::uint32_t)) &&
+              write_all(fd, reinterpret_cast<const char *>(rmq.data()),
+                        rmq.size() * sizeof(std::uint32_t));
+    ok = ::close(fd) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Failed writing \"" << index_path << "\"\n";
+        return 1;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+    return 0;
+}
+
+/* Suffix-array rows [lo, hi) starting with pattern p. */
+static void index_lookup(const char *t, const std::uint32_t *sa, std::uint64_t n,
+                         const std::string &p, std::uint64_t &lo, std::uint64_t &hi) {
+    // <0, 0, >0 for the suffix's first |p| digits against p
+    auto cmp = [&](std::uint32_t s) {
+        std::size_t len = static_cast<std::size_t>(n - s);
+        int c = std::memcmp(t + s, p.data(), std::min(len, p.size()));
+        if (c == 0 && len < p.size()) c = -1;
+        return c;
+    };
+    std::uint64_t a = 0, b = n;
+    while (a < b) {
+        std::uint64_t m = a + (b - a) / 2;
+        if (cmp(sa[m]) < 0) a = m + 1;
+        else b = m;
+    }
+    lo = a;
+    b = n;
+    while (a < b) {
+        std::uint64_t m = a + (b - a) / 2;
+        if (cmp(sa[m]) <= 0) a = m + 1;
+        else b = m;
+    }
+    hi = a;
+}
+
+static int query_index(const std::string &index_path, const std::vector<std::string> &patterns) {
+    int fd = ::open(index_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        std::cerr << "Cannot open index \"" << index_path << "\"\n";
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void *map = size >= 16 ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+
+    const char *base = static_cast<const char *>(map);
+    std::uint64_t n = 0;
+    if (map != MAP_FAILED) std::memcpy(&n, base + 8, sizeof n);
+    if (map == MAP_FAILED || std::memcmp(base, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0 ||
+        n > UINT32_MAX || size != index_size(n)) {
+        std::cerr << "\"" << index_path << "\" is not a digit index\n";
+        if (map != MAP_FAILED) ::munmap(map, size);
+        return 1;
+    }
+    const char *t = base + 16;
+    const std::uint32_t *sa = reinterpret_cast<const std::uint32_t *>(base + index_sa_offset(n));
+    const std::uint32_t *rmq = sa + n;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::ostringstream out;
+    for (const std::string &p : patterns) {
+        std::uint64_t lo, hi;
+        index_lookup(t, sa, n, p, lo, hi);
+        out << p << ": " << hi - lo << " occurrences";
+        if (hi > lo) {
+            std::uint32_t first = index_first(sa, rmq, n, lo, hi);
+            out << ", first at digit " << first + 1ULL;
+        }
+        out << '\n';
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Querying " << patterns.size() << " patterns in " << n
+              << " indexed digits (C++, suffix array)...\n"
+              << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n"
+              << out.str();
+    ::munmap(map, size);
+    return 0;
+}
+
+/* =========================
+   Main
+   ========================= */
+
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        std::cerr << "Usage examples:\n"
+                  << "  " << argv[0] << "\n"
+                  << "  " << argv[0] << " 12345\n"
+                  << "  " << argv[0] << " --calculate 1K\n"
+                  << "  " << argv[0] << " --digits 10M\n"
+                  << "  " << argv[0] << " 1e6\n"
+                  << "  " << argv[0] << " --threads 4 10M\n"
+                  << "  " << argv[0] << " --constant e 1M\n"
+                  << "  " << argv[0] << " --sqrt 2 1M\n"
+                  << "  " << argv[0] << " --digit-at 10000\n"
+                  << "  " << argv[0] << " --continued-fraction 100K\n"
+                  << "  " << argv[0] << " --range 1M:100\n"
+                  << "  " << argv[0] << " --stats 1M\n"
+                  << "  " << argv[0] << " --search 999999,271828 10M\n"
+                  << "  " << argv[0] << " --build-index pi.txt pi.idx\n"
+                  << "  " << argv[0] << " --query pi.idx 999999,271828\n"
+                  << "  " << argv[0] << " --compare pi.txt reference.txt\n"
+                  << "  " << argv[0] << " --self-check 1M\n"
+                  << "  " << argv[0] << " --energy 10M\n"
+                  << "  " << argv[0] << " --cost 1M\n"
+                  << "  " << argv[0] << " --trace-mul pi.mtr 10M\n"
+                  << "  " << argv[0] << " --replay pi.mtr\n";
+        return 1;
+    }
+    progress_install();
+    if (!select_cpu_level(opts.isa)) return 1;
+    ResourceLimits limits = detect_limits();
+    bool auto_threads = opts.threads == 0;
+    if (auto_threads) opts.threads = limits.cpus;
+    opts.auto_threads = auto_threads;
+    if (opts.energy) energy_start();
+    EnergyGuard energy;
+    if (opts.emit_table) energy.out = &std::cerr;
+    cost_counting = opts.cost;
+
+    unsigned long digits = opts.range_len != 0
+                         ? opts.range_start + opts.range_len : opts.digits;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (!opts.index_input.empty()) {
+        return build_index(opts.index_input, opts.index_path, opts.threads);
+    }
+    if (!opts.query.empty()) {
+        return query_index(opts.index_path, opts.query);
+    }
+    if (!opts.compare_a.empty()) {
+        return compare_files(opts.compare_a, opts.compare_b, opts.threads);
+    }
+    if (!opts.pack_in.empty()) {
+        return pack_digit_file(opts.pack_in, opts.pack_out);
+    }
+    if (!opts.replay.empty()) {
+        return replay_mul_trace(opts.replay, opts.threads);
+    }
+    trace_recording = !opts.trace_mul.empty();
+    if (trace_recording && (opts.digit_at != 0 || opts.emit_table)) {
+        std::cerr << "--trace-mul does not apply to "
+                  << (opts.digit_at != 0 ? "--digit-at, which makes no big products\n"
+                                         : "--emit-table, whose output is the table\n");
+        return 1;
+    }
+
+    if (opts.digit_at != 0) {
+        std::cout << "Extracting digits of pi at position " << opts.digit_at
+                  << " (C++, Bellard/Plouffe)...\n";
+        progress_phase(PHASE_EXTRACT);
+        std::string block = extract_digits(opts.digit_at, opts.threads);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+
+        std::cout << block << '\n';
+        if (block.size() < 9) {
+            std::cout << "Only " << block.size() << " digits are certain here: pi is too close "
+                      << "to a digit boundary for the error bound of the sum\n";
+        }
+        return 0;
+    }
+
+    if (opts.cf_terms != 0) {
+        std::cout << "Calculating " << opts.cf_terms
+                  << " partial quotients of pi (C++ + GMP, half-GCD)...\n";
+        std::vector<mpz_class> cf = pi_continued_fraction(opts.cf_terms, opts);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Time: " << std::chrono::duration<double>(end - start).count() << " s\n";
+        if (opts.cost) cost_report();
+        if (trace_recording && write_mul_trace(opts.trace_mul) != 0) return 1;
+
+        std::ostringstream line;
+        for (std::size_t i = 0; i < cf.size(); ++i) {
+            line << (i == 0 ? "[" : i == 1 ? "; " : ", ") << cf[i];
+        }
+        line << "]\n";
+        std::cout << line.str();
+        return 0;
+    }
+
+    StatsSink stats(opts.stats_block);
+    std::vector<DigitSink *> sinks;
+    if (opts.stats) sinks.push_back(&stats);
+    SearchSink search(opts.search, opts.range_start + 1);
+    if (!opts.search.empty()) sinks.push_back(&search);
+    DigestSink digest;
+    sinks.push_back(&digest);
+    bool echo = opts.search.empty();
+
+    bool is_pi = opts.root_degree == 0 && opts.constant == "pi";
+    if (is_pi && !opts.emit_table && digits <= PI_TABLE_DIGITS) {
+        if (trace_recording) {
+            std::cerr << "--trace-mul needs a computed run; pi up to " << PI_TABLE_DIGITS
+                      << " digits is printed from the embedded table\n";
+            return 1;
+        }
+        energy.digits = opts.range_len != 0 ? opts.range_len : digits;
+        int status = print_from_table(opts, digits, start, sinks, echo);
+        if (status == 0) status = self_check_status(opts, digest, digits);
+        return status;
+    }
+
+    std::string label, method = "Newton";
+    const ConstantDef *constant = nullptr;
+    if (opts.root_degree != 0) {
+        label = opts.root_degree == 2
+              ? "sqrt(" + std::to_string(opts.root_radicand) + ")"
+              : std::to_string(opts.root_radicand) + "^(1/" +
+                std::to_string(opts.root_degree) + ")";
+    } else {
+        constant = find_constant(opts.constant);
+        if (!constant) {
+            std::cerr << "Unknown constant \"" << opts.constant << "\", expected one of:";
+            for (const ConstantDef &c : CONSTANTS) std::cerr << ' ' << c.name;
+            std::cerr << "\n";
+            return 1;
+        }
+        label  = constant->label;
+        method = constant->method;
+    }
+
+    if (opts.emit_table && !is_pi) {
+        std::cerr << "--emit-table only applies to pi\n";
+        return 1;
+    }
+    if (opts.emit_table && opts.range_len != 0) {
+        std::cerr << "--emit-table cannot be combined with --range\n";
+        return 1;
+    }
+    if (digits > max_digits_for_gmp()) {
+        std::cerr << digits << " digits need products beyond GMP's 2^31-limb integer limit in the "
+                  << "top merges and the final stage; at most " << max_digits_for_gmp()
+                  << " digits per run\n";
+        return 1;
+    }
+    if (opts.range_len != 0) {
+        std::cout << "Calculating " << label << " digits " << opts.range_start + 1
+                  << ".." << digits << " (C++ + GMP/MPFR, " << method << ")...\n";
+    } else if (!opts.emit_table) {
+        std::cout << "Calculating " << label << " to " << digits
+                  << " digits (C++ + GMP/MPFR, " << method << ")...\n";
+    }
+    // the small pi path runs on one thread whatever the CPU count
+    if (is_pi && pi_small_path(digits, opts)) opts.threads = 1;
+    if (!opts.emit_table) plan_resources(opts, limits, auto_threads, digits);
+
+    mpz_class scaled;
+    if (constant) {
+        constant->compute(digits, opts, scaled);
+    } else {
+        compute_root(opts.root_radicand, opts.root_degree, digits, opts.threads, scaled);
+    }
+
+    if (opts.emit_table) {
+        print_table_header(scaled, digits);
+        return 0;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed =
+        std::chrono::duration<double>(end - start).count();
+
+    std::cout << "Time: " << elapsed << " s\n";
+    if (opts.cost) cost_report();
+    if (trace_recording && write_mul_trace(opts.trace_mul) != 0) return 1;
+
+    if (opts.range_len != 0) {
+        print_range(scaled, opts.range_len, sinks, echo);
+    } else {
+        print_fixed(scaled, digits, sinks, echo);
+    }
+
+    energy.digits = opts.range_len != 0 ? opts.range_len : digits;
+    return self_check_status(opts, digest, digits);
 }